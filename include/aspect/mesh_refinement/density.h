@@ -55,6 +55,23 @@ namespace aspect
         virtual
         void
         execute (Vector<float> &error_indicators) const;
+
+        /**
+         * Request the data this criterion needs from the data shared between
+         * all mesh refinement criteria.
+         */
+        virtual
+        void
+        request_shared_data (SharedData<dim> &shared_data) const;
+
+        /**
+         * Execute this mesh refinement criterion using the data computed as
+         * requested in request_shared_data().
+         */
+        virtual
+        void
+        execute_with_shared_data (const SharedData<dim> &shared_data,
+                                  Vector<float>         &error_indicators) const;
     };
   }
 }
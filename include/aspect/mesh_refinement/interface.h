@@ -25,6 +25,7 @@
 
 #include <aspect/global.h>
 #include <aspect/plugins.h>
+#include <aspect/material_model/interface.h>
 
 #include <deal.II/base/std_cxx1x/shared_ptr.h>
 #include <deal.II/base/table_handler.h>
@@ -37,6 +38,7 @@ namespace aspect
   using namespace dealii;
 
   template <int dim> class Simulator;
+  template <int dim> class SimulatorAccess;
 
 
   /**
@@ -48,6 +50,96 @@ namespace aspect
   namespace MeshRefinement
   {
 
+    /**
+     * A class that holds data several mesh refinement criteria need and
+     * that is expensive to compute, so that it only has to be computed
+     * once when more than one criterion is used. Criteria request what they
+     * need in Interface::request_shared_data(); the Manager then calls
+     * compute() once and passes the result to
+     * Interface::execute_with_shared_data() of all criteria.
+     *
+     * Note that this only avoids computing the same data more than once.
+     * In particular, error indicators for different blocks of the solution
+     * (e.g., for the temperature, each compositional field and the
+     * velocity) are still computed by separate runs of the
+     * KellyErrorEstimator, each of which loops over all faces of the mesh.
+     * The estimator can not compute separate indicators for several
+     * blocks of the same vector in one run, and giving it one copy of the
+     * solution per block costs one full system vector per block.
+     *
+     * @ingroup MeshRefinement
+     */
+    template <int dim>
+    class SharedData
+    {
+      public:
+        /**
+         * Constructor. Initialize the object so that nothing is requested.
+         */
+        SharedData ();
+
+        /**
+         * Request error indicators computed by the KellyErrorEstimator from
+         * the given block of the solution vector, using a Gauss face
+         * quadrature formula with the given number of points in each
+         * coordinate direction.
+         */
+        void
+        request_kelly_indicators (const unsigned int block,
+                                  const unsigned int n_face_quadrature_points);
+
+        /**
+         * Request that the material model be evaluated at the support points
+         * of the temperature element on all locally owned cells.
+         */
+        void
+        request_material_model_values ();
+
+        /**
+         * Compute everything that has been requested. The
+         * KellyErrorEstimator is run only once for each requested
+         * combination of block and face quadrature formula, regardless of
+         * how many criteria have requested it.
+         */
+        void
+        compute (const SimulatorAccess<dim> &simulator_access);
+
+        /**
+         * Return the error indicators previously requested via
+         * request_kelly_indicators() with the same arguments.
+         */
+        const Vector<float> &
+        get_kelly_indicators (const unsigned int block,
+                              const unsigned int n_face_quadrature_points) const;
+
+        /**
+         * The inputs and outputs of the material model at the support
+         * points of the temperature element, with one element for each
+         * locally owned cell in the order in which we encounter them when
+         * iterating over all active cells. Only filled if
+         * request_material_model_values() has been called. Because the
+         * quadrature points and the degrees of freedom of the temperature
+         * element are enumerated in the same way, the values can be used to
+         * compute finite element interpolations of material properties.
+         */
+        std::vector<typename MaterialModel::Interface<dim>::MaterialModelInputs>  material_model_inputs;
+        std::vector<typename MaterialModel::Interface<dim>::MaterialModelOutputs> material_model_outputs;
+
+      private:
+        /**
+         * The requested error indicators, indexed by block and number of
+         * face quadrature points.
+         */
+        std::map<std::pair<unsigned int,unsigned int>, Vector<float> > kelly_indicators;
+
+        /**
+         * Whether the material model values have been requested.
+         */
+        bool material_model_values_requested;
+    };
+
+
+
     /**
      * This class declares the public interface of mesh refinement plugins.
      * These plugins must implement a function that can be called between time
@@ -84,6 +176,30 @@ namespace aspect
         void
         execute (Vector<float> &error_indicators) const = 0;
 
+        /**
+         * Announce which of the data that can be shared between mesh
+         * refinement criteria (see the SharedData class) this criterion
+         * needs. The default implementation requests nothing.
+         */
+        virtual
+        void
+        request_shared_data (SharedData<dim> &shared_data) const;
+
+        /**
+         * Execute this mesh refinement criterion, using data that has been
+         * computed as requested in request_shared_data(). This function is
+         * what the Manager calls. The default implementation ignores the
+         * shared data and calls execute(); criteria that request shared
+         * data should overload it.
+         *
+         * @param[in] shared_data Data computed once for all criteria.
+         * @param[out] error_indicators As for execute().
+         */
+        virtual
+        void
+        execute_with_shared_data (const SharedData<dim> &shared_data,
+                                  Vector<float>         &error_indicators) const;
+
         /**
          * Declare the parameters this class takes through input files.
          * Derived classes should overload this function if they actually do
@@ -232,6 +348,25 @@ namespace aspect
          */
         std::list<std_cxx1x::shared_ptr<Interface<dim> > > mesh_refinement_objects;
 
+        /**
+         * The names of the mesh refinement objects, in the same order as in
+         * the list above.
+         */
+        std::vector<std::string> mesh_refinement_object_names;
+
+        /**
+         * Whether to print how long computing the shared data and each of
+         * the criteria took. This is controlled by the 'Report mesh
+         * refinement times' parameter that the Simulator declares.
+         */
+        bool report_times;
+
+        /**
+         * A pointer to the simulator object, used to compute the data
+         * shared by the criteria.
+         */
+        const Simulator<dim> *simulator;
+
         /**
          * An MPI communicator that spans the set of processors on which the
          * simulator object lives.
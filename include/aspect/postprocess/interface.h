@@ -39,6 +39,11 @@ namespace aspect
 
   template <int dim> class Simulator;
 
+  namespace internal
+  {
+    template <int dim> class PostprocessManagerAccess;
+  }
+
 
   /**
    * A namespace for everything to do with postprocessing solutions every time
@@ -274,6 +279,58 @@ namespace aspect
          * parameter file.
          */
         std::list<std_cxx1x::shared_ptr<Interface<dim> > > postprocessors;
+
+        /**
+         * The names of the postprocessors in the list above, in the same
+         * order.
+         */
+        std::vector<std::string> postprocessor_names;
+
+        /**
+         * For each postprocessor, the number of time steps between two
+         * executions, and the time between two executions as given in the
+         * input file (in years or seconds, depending on the global flag
+         * that determines which unit we use). A value of zero indicates
+         * that the respective postprocessor should be executed in every
+         * time step as far as this criterion is concerned.
+         */
+        std::vector<unsigned int> step_intervals;
+        std::vector<double>       time_intervals;
+
+        /**
+         * For each postprocessor whose time interval is positive, the time
+         * (in seconds) at or after which it should be executed again. This
+         * is part of the state that is saved to and restored from
+         * checkpoints.
+         */
+        std::vector<double>       next_execution_times;
+
+        /**
+         * Whether the time each postprocessor takes should be written into
+         * the statistics file.
+         */
+        bool                      record_postprocessor_times;
+
+        /**
+         * An object that allows us to query the current time and time step
+         * number of the simulator.
+         */
+        std_cxx1x::shared_ptr<aspect::internal::PostprocessManagerAccess<dim> > simulator_access;
+
+        /**
+         * Return whether the postprocessor with the given index in the list
+         * of postprocessors should be executed in the current time step.
+         * If so, also update the time at which it should be executed next.
+         */
+        bool
+        execute_in_this_step (const unsigned int index);
+
+        /**
+         * Store the state of the execution schedule in the given map, and
+         * restore it from there.
+         */
+        void save_schedule (std::map<std::string,std::string> &saved_text) const;
+        void load_schedule (const std::map<std::string,std::string> &saved_text);
     };
 
 
@@ -291,6 +348,7 @@ namespace aspect
            p = postprocessors.begin();
            p != postprocessors.end(); ++p)
         (*p)->save (saved_text);
+      save_schedule (saved_text);
 
       ar &saved_text;
     }
@@ -312,6 +370,7 @@ namespace aspect
            p = postprocessors.begin();
            p != postprocessors.end(); ++p)
         (*p)->load (saved_text);
+      load_schedule (saved_text);
     }
 
 
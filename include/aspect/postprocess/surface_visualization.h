@@ -0,0 +1,170 @@
+/*
+  Copyright (C) 2014 by the authors of the ASPECT code.
+
+  This file is part of ASPECT.
+
+  ASPECT is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  ASPECT is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ASPECT; see the file doc/COPYING.  If not see
+  <http://www.gnu.org/licenses/>.
+*/
+/*  $Id$  */
+
+
+#ifndef __aspect__postprocess_surface_visualization_h
+#define __aspect__postprocess_surface_visualization_h
+
+#include <aspect/postprocess/interface.h>
+#include <aspect/postprocess/visualization.h>
+#include <aspect/simulator_access.h>
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+
+    /**
+     * A postprocessor that generates graphical output of the solution on a
+     * selected part of the boundary of the domain, for example the free
+     * surface, in periodic intervals or every time step. Since only faces
+     * of the mesh are written, these files are much smaller than the ones
+     * generated by the Visualization postprocessor. The output contains the
+     * solution variables and, if a free surface is used, the velocity with
+     * which the mesh moves. In addition, the derived quantities provided by
+     * the visualization postprocessor plugins that compute point-wise
+     * values (i.e., that are derived from DataPostprocessor) can be added.
+     *
+     * @ingroup Postprocessing
+     */
+    template <int dim>
+    class SurfaceVisualization : public Interface<dim>, public ::aspect::SimulatorAccess<dim>
+    {
+      public:
+        /**
+         * Constructor.
+         */
+        SurfaceVisualization ();
+
+        /**
+         * Generate graphical output on the selected boundary from the
+         * current solution.
+         */
+        virtual
+        std::pair<std::string,std::string>
+        execute (TableHandler &statistics);
+
+        /**
+         * Initialize this class for a given simulator. In addition to calling
+         * the respective function from the base class, this function also
+         * initializes all the visualization postprocessor plugins.
+         *
+         * @param simulator A reference to the main simulator object to which
+         * the postprocessor implemented in the derived class should be
+         * applied.
+         */
+        virtual void initialize (const Simulator<dim> &simulator);
+
+        /**
+         * Declare the parameters this class takes through input files.
+         */
+        static
+        void
+        declare_parameters (ParameterHandler &prm);
+
+        /**
+         * Read the parameters this class declares from the parameter file.
+         */
+        virtual
+        void
+        parse_parameters (ParameterHandler &prm);
+
+        /**
+         * Save the state of this object.
+         */
+        virtual
+        void save (std::map<std::string, std::string> &status_strings) const;
+
+        /**
+         * Restore the state of the object.
+         */
+        virtual
+        void load (const std::map<std::string, std::string> &status_strings);
+
+        /**
+         * Serialize the contents of this class as far as they are not read
+         * from input parameter files.
+         */
+        template <class Archive>
+        void serialize (Archive &ar, const unsigned int version);
+
+      private:
+        /**
+         * Interval between the generation of graphical output. This parameter
+         * is read from the input file and consequently is not part of the
+         * state that needs to be saved and restored.
+         *
+         * For technical reasons, this value is stored as given in the input
+         * file and upon use is either interpreted as seconds or years,
+         * depending on how the global flag in the input parameter file is
+         * set.
+         */
+        double output_interval;
+
+        /**
+         * A time (in years) after which the next time step should produce
+         * graphical output again.
+         */
+        double next_output_time;
+
+        /**
+         * Consecutively counted number indicating the how-manyth time we will
+         * create output the next time we get to it.
+         */
+        unsigned int output_file_number;
+
+        /**
+         * The boundary indicators of those parts of the boundary on which we
+         * are to generate output, as given in the input file. If empty, we
+         * use the free surface boundary indicators or, if there is no free
+         * surface, the entire boundary.
+         */
+        std::set<types::boundary_id> boundary_indicators;
+
+        /**
+         * A list of visualization postprocessor objects that have been
+         * requested in the parameter file.
+         */
+        std::list<std_cxx1x::shared_ptr<VisualizationPostprocessors::Interface<dim> > > postprocessors;
+
+        /**
+         * A list of pairs (time, pvtu_filename) that have so far been written
+         * and that we will pass to DataOutInterface::write_pvd_record to
+         * create a master file that can make the association between
+         * simulation time and corresponding file name.
+         */
+        std::vector<std::pair<double,std::string> > times_and_pvtu_names;
+
+        /**
+         * Compute the next output time from the current one. In the simplest
+         * case, this is simply the previous next output time plus the
+         * interval, but in general we'd like to ensure that it is larger than
+         * the current time to avoid falling behind with next_output_time and
+         * having to catch up once the time step becomes larger.
+         */
+        void set_next_output_time (const double current_time);
+    };
+  }
+}
+
+
+#endif
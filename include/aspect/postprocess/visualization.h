@@ -291,6 +291,28 @@ namespace aspect
                                               void (*declare_parameters_function) (ParameterHandler &),
                                               VisualizationPostprocessors::Interface<dim> *(*factory_function) ());
 
+        /**
+         * Return a list of the names of all registered visualization
+         * postprocessors, separated by vertical bars, in a format suitable
+         * for Patterns::MultipleSelection. This allows other postprocessors
+         * that generate graphical output (e.g., only on part of the domain) to
+         * offer the same derived quantities as this class.
+         */
+        static
+        std::string
+        get_names_of_visualization_postprocessors ();
+
+        /**
+         * Create the visualization postprocessor with the given name and let
+         * it read its run-time parameters from the given parameter object.
+         * Ownership of the object is handed over to the caller of this
+         * function.
+         */
+        static
+        VisualizationPostprocessors::Interface<dim> *
+        create_visualization_postprocessor (const std::string &name,
+                                            ParameterHandler  &prm);
+
         /**
          * Declare the parameters this class takes through input files.
          */
@@ -367,10 +389,55 @@ namespace aspect
          * VTU file output supports grouping files from several CPUs into one
          * file using MPI I/O when writing on a parallel filesystem. 0 means
          * no grouping (and no parallel I/O). 1 will generate one big file
-         * containing the whole solution.
+         * containing the whole solution. Larger values generate this many
+         * files, each written by a group of consecutive processors.
          */
         unsigned int group_files;
 
+        /**
+         * The number of subdivisions of each cell when building the patches
+         * that are written into graphical output files. A value of one
+         * outputs the (bi-/tri-)linear interpolation of the solution on each
+         * cell.
+         */
+        unsigned int n_subdivisions;
+
+        /**
+         * The zlib compression level to be used for the VTU output format,
+         * as given in the input file. See the documentation of the
+         * corresponding parameter for possible values.
+         */
+        std::string compression_level;
+
+        /**
+         * Whether to record the size of the graphical output files and the
+         * time it took to write them in the statistics file.
+         */
+        bool record_output_statistics;
+
+        /**
+         * The total number of bytes this processor has written into
+         * graphical output files since the program was started, and the total
+         * wall time it spent converting the data into the selected output
+         * format and writing it to disk. These variables are updated by the
+         * background threads and are therefore protected by
+         * write_statistics_mutex.
+         */
+        double total_bytes_written;
+        double total_write_time;
+
+        /**
+         * A mutex that guards access to total_bytes_written and
+         * total_write_time.
+         */
+        Threads::Mutex write_statistics_mutex;
+
+        /**
+         * Add the given number of bytes and wall time to the totals above.
+         */
+        void record_write_statistics (const double bytes_written,
+                                      const double write_time);
+
         /**
          * Compute the next output time from the current one. In the simplest
          * case, this is simply the previous next output time plus the
@@ -398,10 +465,53 @@ namespace aspect
         std::string last_mesh_file_name;
 
         /**
-         * Handle to a thread that is used to write data in the background.
-         * The background_writer() function runs on this background thread.
+         * Write the .pvtu record for the given list of files that together
+         * make up the output of the current time step, as well as the .visit
+         * record for this time step and the .pvd and .visit records that
+         * collect all time steps so far. This function must only be called
+         * on the master processor.
+         */
+        void write_master_files (const DataOutInterface<dim,dim> &data_out,
+                                 const std::string               &solution_file_prefix,
+                                 const std::vector<std::string>  &filenames);
+
+        /**
+         * The maximal number of output steps whose data may be encoded and
+         * written in the background at the same time. If this number is
+         * reached when we want to generate output again, execute() waits for
+         * the oldest of these background operations to finish before
+         * starting a new one.
+         */
+        unsigned int max_pending_writes;
+
+        /**
+         * Handles to the threads that are used to encode and write data in
+         * the background, in the order in which they were started. The
+         * background_encoder() function runs on these background threads.
+         * The list has at most max_pending_writes elements.
+         */
+        std::list<Threads::Thread<void> > background_threads;
+
+        /**
+         * Wait for background threads to finish until there are at most
+         * @p n_remaining of them still running.
+         */
+        void wait_for_background_threads (const unsigned int n_remaining);
+
+        /**
+         * A function that encodes the patches stored in the second argument
+         * in the given output format and then writes the result to a file
+         * with the name given in the first argument using
+         * background_writer(). The function is run on a separate thread to
+         * allow computations to continue while graphical output is still
+         * being generated. The function takes over ownership of its pointer
+         * arguments and deletes them at the end of its work. It also records
+         * the size of the data written and the time it took via
+         * record_write_statistics().
          */
-        Threads::Thread<void> background_thread;
+        void background_encoder (const std::string                  *filename,
+                                 const DataOutInterface<dim,dim>    *patches,
+                                 const DataOutBase::OutputFormat     output_format);
 
         /**
          * A function that writes the text in the second argument to a file
@@ -82,6 +82,26 @@ namespace aspect
     }
   }
 
+  /**
+   * Given the current number of active cells of a mesh and the number of
+   * cells it should have after the next refinement step, return the
+   * fractions of cells to refine and to coarsen (in this order) to pass to
+   * GridRefinement::refine_and_coarsen_fixed_number(). The given refinement
+   * and coarsening fractions are used as the starting point: if refining
+   * and coarsening by them would yield more cells than desired, the
+   * refinement fraction is reduced and, if necessary, the coarsening
+   * fraction increased, and vice versa. Both fractions are in [0,1].
+   *
+   * This function is implemented in
+   * <code>source/simulator/core.cc</code>.
+   */
+  template <int dim>
+  std::pair<double,double>
+  fractions_for_target_n_cells (const double n_cells,
+                                const double target_n_cells,
+                                const double refinement_fraction,
+                                const double coarsening_fraction);
+
   /**
    * This is the main class of ASPECT. It implements the overall simulation
    * algorithm using the numerical methods discussed in the papers and manuals
@@ -178,13 +198,23 @@ namespace aspect
         double                         CFL_number;
         double                         maximum_time_step;
         bool                           use_conduction_timestep;
+        bool                           use_temporal_error_control;
+        double                         temporal_error_tolerance;
+        double                         maximum_CFL_number;
         bool                           convert_to_years;
         std::string                    output_directory;
+        bool                           append_to_statistics_file;
+        bool                           write_statistics_csv_file;
+        unsigned int                   n_depth_average_quadrature_points;
         double                         surface_pressure;
         double                         adiabatic_surface_temperature;
         unsigned int                   timing_output_frequency;
         double                         linear_stokes_solver_tolerance;
         unsigned int                   max_nonlinear_iterations;
+        unsigned int                   nonlinear_acceleration_depth;
+        bool                           use_adaptive_linear_solver_tolerance;
+        bool                           use_newton_linearization;
+        double                         newton_derivative_scaling_factor;
         unsigned int                   n_cheap_stokes_solver_steps;
         double                         temperature_solver_tolerance;
         double                         composition_solver_tolerance;
@@ -211,6 +241,7 @@ namespace aspect
          * conditions (e.g. "function")
          */
         std::map<types::boundary_id, std::pair<std::string,std::string> > prescribed_velocity_boundary_indicators;
+        bool                           reuse_stokes_matrix_with_prescribed_velocities;
         /**
          * Selection of operations to perform to remove nullspace from
          * velocity field.
@@ -232,6 +263,11 @@ namespace aspect
         std::vector<double>            additional_refinement_times;
         unsigned int                   adaptive_refinement_interval;
         bool                           run_postprocessors_on_initial_refinement;
+        bool                           reuse_solution_on_initial_refinement;
+        bool                           report_refinement_times;
+        unsigned int                   refinement_target_n_cells;
+        unsigned int                   refinement_target_dofs_per_process;
+        double                         refinement_skip_threshold;
         /**
          * @}
          */
@@ -254,6 +290,10 @@ namespace aspect
          */
         int                            checkpoint_time_secs;
         int                            checkpoint_steps;
+        int                            checkpoint_compression_level;
+        bool                           checkpoint_in_background;
+        double                         checkpoint_model_time;
+        unsigned int                   n_old_checkpoints;
         /**
          * @}
          */
@@ -493,6 +533,28 @@ namespace aspect
        */
       void solve_timestep ();
 
+      /**
+       * Within the nonlinear iterations of solve_timestep(), switch from the
+       * Newton to the Picard linearization of the Stokes equation for the
+       * remainder of the current time step. Called if the Stokes residual
+       * increases between two iterations.
+       *
+       * This function is implemented in
+       * <code>source/simulator/core.cc</code>.
+       */
+      void fall_back_to_picard_linearization ();
+
+      /**
+       * Call solve_timestep() and, if temporal error control is used, estimate
+       * the error of the time step just computed. If the error exceeds the
+       * tolerance, reduce the time step and solve again until the error is
+       * acceptable.
+       *
+       * This function is implemented in
+       * <code>source/simulator/core.cc</code>.
+       */
+      void solve_timestep_with_error_control ();
+
       /**
        * Initiate the assembly of the Stokes preconditioner matrix via
        * assemble_stokes_preconditoner(), then set up the data structures to
@@ -641,6 +703,20 @@ namespace aspect
        */
       void setup_system_matrix (const std::vector<IndexSet> &system_partitioning);
 
+      /**
+       * Make sure that the diagonal block of the system matrix that
+       * corresponds to the given compositional field has storage for its
+       * entries. If all compositional fields are numbered alike,
+       * setup_system_matrix() only allocates one of these blocks, and this
+       * function moves the sparsity pattern of that block to the one of the
+       * given field and releases the previous one. Otherwise, every field
+       * has its own block and this function does nothing.
+       *
+       * This function is implemented in
+       * <code>source/simulator/core.cc</code>.
+       */
+      void allocate_composition_matrix_block (const unsigned int compositional_variable);
+
       /**
        * Set up the size and structure of the matrix used to store the
        * elements of the matrix that is used to build the preconditioner for
@@ -711,6 +787,21 @@ namespace aspect
       void
       copy_local_to_global_stokes_system (const internal::Assembly::CopyData::StokesSystem<dim> &data);
 
+      /**
+       * Return whether the Stokes right hand side is assembled without
+       * rebuilding the matrix, but possibly for different boundary values
+       * than the ones the matrix was built with. In that case, the
+       * contributions of the prescribed boundary values to the right hand
+       * side need the local matrices of the cells on which they are
+       * prescribed. See the "Reuse Stokes matrix with prescribed
+       * velocities" parameter.
+       *
+       * This function is implemented in
+       * <code>source/simulator/assembly.cc</code>.
+       */
+      bool
+      stokes_rhs_needs_local_matrices () const;
+
       /**
        * Compute the integrals for one advection matrix and right hand side on
        * a single cell.
@@ -786,20 +877,62 @@ namespace aspect
       void get_artificial_viscosity (Vector<float> &viscosity_per_cell) const;
 
       /**
-       * Internal routine to compute the depth average of a certain quantitiy.
-       * The functor @p fctr should implement: 1. bool
-       * need_material_properties() 2. void setup(unsigned int q_points) 3.
-       * double operator()(const MaterialModelInputs & in, const
-       * MaterialModelOutputs & out, FEValues<dim> & fe_values, const
-       * LinearAlgebra::BlockVector &solution, std::vector<double> & output)
+       * Internal routine to compute the depth averages of a number of
+       * quantities in a single pass over the mesh. The functor @p fctr
+       * should implement: 1. bool need_material_properties() 2. void
+       * setup(unsigned int q_points) 3. void operator()(const
+       * MaterialModelInputs & in, const MaterialModelOutputs & out,
+       * FEValues<dim> & fe_values, const LinearAlgebra::BlockVector
+       * &solution, std::vector<std::vector<double> > & output), where
+       * output[f][q] is to be set to the value of the f-th quantity at the
+       * q-th quadrature point. The material model is evaluated at most once
+       * per cell, and the results for all quantities are summed over all
+       * processors in a single reduction.
        *
+       * @param values The output vectors of depth averaged values, one for
+       * each quantity computed by the functor. The function takes the
+       * pre-existing size of these vectors as the number of depth slices;
+       * all of them need to have the same size.
+       */
+      template<class FUNCTOR>
+      void compute_depth_average(std::vector<std::vector<double> > &values,
+                                 FUNCTOR &fctr) const;
+
+      /**
+       * Compute depth averages of several quantities at once. Possible
+       * quantities are "temperature", "C_i" for the i-th compositional
+       * field (counting from zero), "velocity magnitude", "sinking
+       * velocity", "viscosity", "Vs" and "Vp". All of them are computed in a
+       * single pass over the mesh, using a single evaluation of the material
+       * model per cell.
+       *
+       * During postprocessing, results are stored in the
+       * depth_average_cache and only the quantities not already computed in
+       * the current postprocessing step are evaluated.
+       *
+       * This function is implemented in
+       * <code>source/simulator/helper_functions.cc</code>.
+       *
+       * @param quantities The names of the quantities to average.
+       * @param values The output vectors of depth averaged values, one for
+       * each element of @p quantities. The function takes the pre-existing
+       * size of these vectors as the number of depth slices; all of them
+       * need to have the same size.
+       */
+      void compute_depth_averages(const std::vector<std::string> &quantities,
+                                  std::vector<std::vector<double> > &values) const;
+
+      /**
+       * Compute the depth average of a single one of the quantities
+       * understood by compute_depth_averages().
+       *
+       * @param quantity The name of the quantity to average.
        * @param values The output vector of depth averaged values. The
        * function takes the pre-existing size of this vector as the number of
        * depth slices.
        */
-      template<class FUNCTOR>
-      void compute_depth_average(std::vector<double> &values,
-                                 FUNCTOR &fctr) const;
+      void compute_single_depth_average(const std::string &quantity,
+                                        std::vector<double> &values) const;
 
       /**
        * Compute a depth average of the current temperature/composition. The
@@ -1026,6 +1159,36 @@ namespace aspect
        */
       std::pair<double,bool> compute_time_step () const;
 
+      /**
+       * Estimate the error of the time discretization in the current time
+       * step. To this end, compare the temperature and compositional fields
+       * computed with the BDF2 scheme with their linear extrapolation from
+       * the previous two time steps. This is the predictor we start the
+       * nonlinear iterations from, and its local error is only of second
+       * order in the time step, compared to third order for the BDF2
+       * scheme. The returned error is the largest difference in any of these
+       * fields, i.e., an embedded second order estimate. It is
+       * relative to the range of values of each field and to the
+       * temporal error tolerance, so a value larger than one means that the
+       * step should be rejected.
+       *
+       * This function is implemented in
+       * <code>source/simulator/helper_functions.cc</code>.
+       */
+      double compute_temporal_error_estimate () const;
+
+      /**
+       * Compute the size of the next time step from the error estimates of
+       * the current and previous time steps using a PI controller. The
+       * result is limited by the time step for the maximum CFL number
+       * allowed with temporal error control. If no error estimate is
+       * available, return the time step computed by compute_time_step().
+       *
+       * This function is implemented in
+       * <code>source/simulator/helper_functions.cc</code>.
+       */
+      double compute_controlled_time_step () const;
+
       /**
        * Compute the artificial diffusion coefficient value on a cell given
        * the values and gradients of the solution passed as arguments.
@@ -1124,10 +1287,36 @@ namespace aspect
        * number of linear solver iterations, and whatever the postprocessors
        * have generated, to disk.
        *
+       * If the statistics file is written incrementally, the last row of
+       * the table is only written once the next row has been started,
+       * since values may still be added to it, unless @p write_all_rows
+       * is true.
+       *
        * This function is implemented in
        * <code>source/simulator/helper_functions.cc</code>.
        */
-      void output_statistics();
+      void output_statistics (const bool write_all_rows = false);
+
+      /**
+       * Return the number of entries in each column of the statistics
+       * table, so that entries added later can be removed again with
+       * truncate_statistics(). This is used when a time step is rejected
+       * and computed again.
+       *
+       * This function is implemented in
+       * <code>source/simulator/helper_functions.cc</code>.
+       */
+      std::map<std::string,unsigned int> get_statistics_column_lengths () const;
+
+      /**
+       * Remove all entries from the statistics table that have been added
+       * since get_statistics_column_lengths() returned @p column_lengths,
+       * including columns that did not exist at that time.
+       *
+       * This function is implemented in
+       * <code>source/simulator/helper_functions.cc</code>.
+       */
+      void truncate_statistics (const std::map<std::string,unsigned int> &column_lengths);
       /**
        * @}
        */
@@ -1166,6 +1355,68 @@ namespace aspect
        * or if we want to terminate altogether.
        */
       Threads::Thread<>                   output_statistics_thread;
+
+      /**
+       * The thread on which create_snapshot() compresses and writes the
+       * serialized state of this object, if checkpoints are written in the
+       * background. We wait for it before we create the next snapshot and
+       * before terminating.
+       */
+      Threads::Thread<>                   checkpoint_thread;
+
+      /**
+       * The error message of the last failed attempt to write the
+       * simulator state of a checkpoint, or an empty string. Since the
+       * state may be written on checkpoint_thread, errors can not be
+       * reported by exceptions and are instead reported the next time we
+       * wait for that thread.
+       */
+      std::string                         checkpoint_error_message;
+
+      /**
+       * If the statistics file is written incrementally (see the 'Append to
+       * statistics file' parameter), these variables record which columns
+       * the files on disk currently have and how many rows of the table
+       * have already been written to them. A change in the set of columns
+       * leads to the files being rewritten completely.
+       */
+      std::vector<std::string>            statistics_columns_written;
+      unsigned int                        statistics_rows_written;
+
+      /**
+       * A cache for depth averages computed by compute_depth_averages(),
+       * indexed by the name of the averaged quantity and the
+       * number of depth slices. Several postprocessors (e.g., the
+       * DepthAverage postprocessor and the seismic anomaly visualization
+       * plugins) need the same averages, so we only compute them once per
+       * postprocessing step. The cache is only used while
+       * depth_average_cache_enabled is true, i.e., while postprocess() runs
+       * and the solution can not change; it is cleared before and after.
+       */
+      mutable std::map<std::pair<std::string,unsigned int>, std::vector<double> > depth_average_cache;
+      bool                                                    depth_average_cache_enabled;
+
+      /**
+       * Information about the quadrature points used in
+       * compute_depth_average() that only depends on the mesh: the index
+       * of the depth slice into which each quadrature point on each locally
+       * owned cell falls, and its JxW value, in the order in which we
+       * traverse cells and quadrature points. The slice indices are valid
+       * for depth_average_n_slices slices. These vectors are filled on first
+       * use and cleared whenever the mesh changes, i.e., in setup_dofs() and
+       * when the free surface moves the mesh.
+       */
+      mutable std::vector<unsigned int>                       depth_average_slices;
+      mutable std::vector<double>                             depth_average_JxW;
+      mutable unsigned int                                    depth_average_n_slices;
+
+      /**
+       * The global l2 norm of the error indicators the last time the mesh
+       * was actually refined. Used to skip refinement if the indicators have
+       * not changed significantly since then; see the 'Skip refinement
+       * threshold' parameter. Zero if the mesh has not been refined yet.
+       */
+      double                                                  last_refinement_indicator_norm;
       /**
        * @}
        */
@@ -1194,6 +1445,16 @@ namespace aspect
       double                                                    time_step;
       double                                                    old_time_step;
       unsigned int                                              timestep_number;
+
+      /**
+       * If temporal error control is used, the estimated errors of the last
+       * two time steps relative to the temporal error tolerance (zero if no
+       * estimate is available), and the number of time steps that have been
+       * rejected so far.
+       */
+      double                                                    temporal_error_estimate;
+      double                                                    old_temporal_error_estimate;
+      unsigned int                                              n_rejected_time_steps;
       /**
        * @}
        */
@@ -1277,6 +1538,31 @@ namespace aspect
 //TODO: use n_compositional_field separate preconditioners
       std_cxx1x::shared_ptr<LinearAlgebra::PreconditionILU>     C_preconditioner;
 
+      /**
+       * The block of the system matrix that currently stores the sparsity
+       * pattern shared by all compositional fields, or
+       * numbers::invalid_unsigned_int if every compositional field has its
+       * own block. See allocate_composition_matrix_block().
+       */
+      unsigned int                                              composition_matrix_block;
+
+      /**
+       * If positive, the relative tolerance the linear solvers use in the
+       * current nonlinear iteration, unless the tolerances given in the
+       * input file are larger. See the "Use adaptive linear solver
+       * tolerance" parameter.
+       */
+      double                                                    adaptive_linear_solver_tolerance;
+
+      /**
+       * The factor with which the derivative of the viscosity with respect
+       * to the strain rate enters the Stokes matrix in the current
+       * nonlinear iteration. Zero selects the Picard linearization, one the
+       * full Newton linearization. See the "Use Newton linearization"
+       * parameter.
+       */
+      double                                                    newton_derivative_scaling;
+
       bool                                                      rebuild_stokes_matrix;
       bool                                                      rebuild_stokes_preconditioner;
 
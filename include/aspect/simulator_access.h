@@ -247,6 +247,19 @@ namespace aspect
       const LinearAlgebra::BlockVector &
       get_old_solution () const;
 
+      /**
+       * Return a reference to the vector that has the velocity with which
+       * the mesh moves if a free surface is used. The vector has the same
+       * layout as the one returned by get_solution() but only its velocity
+       * components are meaningful. If no free surface is used, the content
+       * of this vector is undefined.
+       *
+       * @note In general the vector is a distributed vector; however, it
+       * contains ghost elements for all locally relevant degrees of freedom.
+       */
+      const LinearAlgebra::BlockVector &
+      get_mesh_velocity () const;
+
       /**
        * Return a reference to the DoFHandler that is used to discretize the
        * variables at the current time step.
@@ -342,6 +355,25 @@ namespace aspect
        */
       void
       get_depth_average_Vp(std::vector<double> &values) const;
+
+      /**
+       * Compute the depth averages of several quantities at once. This is
+       * considerably cheaper than calling the individual get_depth_average_*
+       * functions one after the other because the mesh is only traversed
+       * once and the material model is evaluated only once per cell.
+       *
+       * @param quantities The names of the quantities whose depth averages
+       * are to be computed. Possible values are "temperature", "C_i" for
+       * the i-th compositional field (counting from zero), "velocity
+       * magnitude", "sinking velocity", "viscosity", "Vs" and "Vp".
+       * @param values The output vectors of depth averaged values, one for
+       * each of the quantities. The function takes the pre-existing size of
+       * these vectors as the number of depth slices; all of them need to
+       * have the same size.
+       */
+      void
+      get_depth_averages(const std::vector<std::string> &quantities,
+                         std::vector<std::vector<double> > &values) const;
       /** @} */
 
 
@@ -404,6 +436,14 @@ namespace aspect
       const std::set<types::boundary_id> &
       get_fixed_temperature_boundary_indicators () const;
 
+      /**
+       * Return a set of boundary indicators that describes which of the
+       * boundaries are free surfaces. The set is empty if the model does not
+       * use a free surface.
+       */
+      const std::set<types::boundary_id> &
+      get_free_surface_boundary_indicators () const;
+
 
       /**
        * A convenience function that copies the values of the compositional
@@ -423,6 +463,13 @@ namespace aspect
        * A pointer to the simulator object to which we want to get access.
        */
       const Simulator<dim> *simulator;
+
+      /**
+       * The class that computes data shared between mesh refinement
+       * criteria needs access to the same information as the criteria
+       * themselves.
+       */
+      template <int> friend class MeshRefinement::SharedData;
   };
 }
 
@@ -26,6 +26,10 @@
 #include <aspect/velocity_boundary_conditions/interface.h>
 #include <aspect/simulator_access.h>
 
+#include <deal.II/base/thread_management.h>
+
+#include <map>
+
 
 namespace aspect
 {
@@ -68,11 +72,32 @@ namespace aspect
            */
           bool fexists(const std::string &filename) const;
 
+          /**
+           * Destructor. Waits for a file that is being read in the
+           * background, if any.
+           */
+          ~GPlatesLookup();
+
           /**
            * Loads a gplates .gpml velocity file. Throws an exception if the
-           * file does not exist.
+           * file does not exist. The file is only read on the root process
+           * of the given communicator (or, if it has been prefetched, taken
+           * from the data read in the background) and then sent to all other
+           * processes, so this function needs to be called on all processes
+           * at the same time.
+           */
+          void load_file(const std::string &filename,
+                         const bool screen_output,
+                         const MPI_Comm mpi_communicator);
+
+          /**
+           * Start reading the given file on a separate thread so that it is
+           * already available when load_file() is called for it later on.
+           * This function should only be called on the root process, since
+           * that is the only one that reads files. It is not an error if
+           * the file does not exist; load_file() will then report it.
            */
-          void load_file(const std::string &filename, const bool screen_output);
+          void prefetch_file(const std::string &filename);
 
           /**
            * Returns the computed surface velocity in cartesian coordinates.
@@ -86,8 +111,81 @@ namespace aspect
           Tensor<1,dim> surface_velocity(const Point<dim> &position,
                                          const double time_weight) const;
 
+          /**
+           * Delete all cached interpolation stencils that have not been used
+           * since the last call to this function. This is called once per
+           * time step, so that the stencils of points that are no longer
+           * part of the mesh (because the mesh has been refined or moved)
+           * do not accumulate.
+           */
+          void
+          remove_unused_stencils ();
+
         private:
 
+          /**
+           * Read the velocities stored in a gplates .gpml file, as pairs of
+           * velocities in theta and phi direction for all points of the
+           * data grid, into the given vector. Rather than building a tree
+           * of the entire XML file, this function only looks for the parts
+           * of the file we need. Returns false if the file could not be read
+           * or has an unexpected format.
+           */
+          static
+          bool
+          read_gpml_file(const std::string   &filename,
+                         std::vector<double> *velocities);
+
+          /**
+           * The name of a file read in the background by prefetch_file(), the
+           * thread that reads it, and where it puts the velocities it reads.
+           * The file name is empty if no such thread has been started or its
+           * result has already been used.
+           */
+          std::string         prefetched_filename;
+          Threads::Thread<bool> prefetch_thread;
+          std::vector<double> prefetched_velocities;
+
+          /**
+           * The data necessary to interpolate the velocity at one evaluation
+           * point from the data points in its neighborhood. The interpolated
+           * velocity is the sum over all data points of the stencil of the
+           * velocity at that data point, multiplied by a matrix that
+           * includes both the normalized interpolation weight of the point
+           * and the rotation that makes the velocity tangential to the
+           * surface at the evaluation point. Since this only depends on the
+           * geometry of the data grid and the position of the evaluation
+           * point, but not on the velocities themselves, it can be computed
+           * once and reused for all velocity files.
+           */
+          struct InterpolationStencil
+          {
+            std::vector<std::pair<unsigned int,unsigned int> > data_point_indices;
+            std::vector<Tensor<2,3> >                          weighted_rotations;
+
+            /**
+             * Whether this stencil has been used since the last call to
+             * remove_unused_stencils().
+             */
+            bool used;
+          };
+
+          /**
+           * A cache of interpolation stencils, indexed by the coordinates of
+           * the evaluation points. The boundary velocity is evaluated at the
+           * same points in every time step as long as the mesh does not
+           * change, so most lookups after the first time step find their
+           * stencil here. The cache is emptied if the resolution of the data
+           * grid changes.
+           */
+          mutable std::map<std::pair<double,std::pair<double,double> >, InterpolationStencil> stencil_cache;
+
+          /**
+           * A mutex that guards access to the cache above, since boundary
+           * values may be evaluated on several threads at once.
+           */
+          mutable Threads::Mutex stencil_cache_mutex;
+
           /**
            * Tables which contain the velocities
            */
@@ -181,18 +279,27 @@ namespace aspect
           calculate_spatial_index(int *index, const Tensor<1,3> position) const;
 
           /**
-           * This function adds a certain data point to the interpolated
-           * surface velocity at this evaluation point. This includes
-           * calculating the interpolation weight and the rotation of the
-           * velocity to the evaluation point position (the velocity need to
-           * be tangential to the surface).
+           * This function adds a certain data point to the interpolation
+           * stencil of an evaluation point. This includes calculating the
+           * interpolation weight and the rotation of the velocity to the
+           * evaluation point position (the velocity need to be tangential
+           * to the surface). The weight is not yet normalized. Returns the
+           * weight of the point, or -1 if check_termination is set and the
+           * point is outside of the interpolation width.
            */
           double
-          add_interpolation_point(Tensor<1,3> &surf_vel,
-                                  const Tensor<1,3> position,
-                                  const int spatial_index[2],
-                                  const double time_weight,
-                                  const bool check_termination) const;
+          add_stencil_point(InterpolationStencil &stencil,
+                            const Tensor<1,3> position,
+                            const int spatial_index[2],
+                            const bool check_termination) const;
+
+          /**
+           * Compute the interpolation stencil for the given evaluation
+           * point.
+           */
+          void
+          compute_stencil (const Tensor<1,3> position,
+                           InterpolationStencil &stencil) const;
 
           /**
            * Returns a velocity vector that is rotated to be tangential to the
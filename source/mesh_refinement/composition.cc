@@ -49,26 +49,40 @@ namespace aspect
     template <int dim>
     void
     Composition<dim>::execute(Vector<float> &indicators) const
+    {
+      SharedData<dim> shared_data;
+      request_shared_data (shared_data);
+      shared_data.compute (*this);
+      execute_with_shared_data (shared_data, indicators);
+    }
+
+
+
+    template <int dim>
+    void
+    Composition<dim>::request_shared_data (SharedData<dim> &shared_data) const
     {
       AssertThrow (this->n_compositional_fields() >= 1,
                    ExcMessage ("This refinement criterion can not be used when no "
                                "compositional fields are active!"));
-      indicators = 0;
 
+//TODO: Replace the 2 by something reasonable, adjusted to the polynomial degree
       for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-        {
-          Vector<float> this_indicator (indicators.size());
+        shared_data.request_kelly_indicators (this->introspection().block_indices.compositional_fields[c], 2);
+    }
 
-          KellyErrorEstimator<dim>::estimate (this->get_dof_handler(),
-//TODO: Replace the 2 by something reasonable, adjusted to the polynomial degree
-                                              QGauss<dim-1>(2),
-                                              typename FunctionMap<dim>::type(),
-                                              this->get_solution(),
-                                              this_indicator,
-                                              this->introspection().component_masks.compositional_fields[c],
-                                              0,
-                                              0,
-                                              this->get_triangulation().locally_owned_subdomain());
+
+
+    template <int dim>
+    void
+    Composition<dim>::execute_with_shared_data (const SharedData<dim> &shared_data,
+                                                Vector<float>         &indicators) const
+    {
+      indicators = 0;
+      for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
+        {
+          Vector<float> this_indicator
+            = shared_data.get_kelly_indicators (this->introspection().block_indices.compositional_fields[c], 2);
           for (unsigned int i=0; i<indicators.size(); ++i)
             this_indicator[i] *= composition_scaling_factors[c];
           indicators += this_indicator;
@@ -23,6 +23,11 @@
 #include <aspect/mesh_refinement/interface.h>
 #include <aspect/simulator_access.h>
 
+#include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
+#include <deal.II/fe/fe_values.h>
+#include <deal.II/numerics/error_estimator.h>
+
 #include <typeinfo>
 
 
@@ -30,6 +35,149 @@ namespace aspect
 {
   namespace MeshRefinement
   {
+// ------------------------------ SharedData -----------------------------
+
+    template <int dim>
+    SharedData<dim>::SharedData ()
+      :
+      material_model_values_requested (false)
+    {}
+
+
+
+    template <int dim>
+    void
+    SharedData<dim>::request_kelly_indicators (const unsigned int block,
+                                               const unsigned int n_face_quadrature_points)
+    {
+      kelly_indicators[std::make_pair (block, n_face_quadrature_points)] = Vector<float>();
+    }
+
+
+
+    template <int dim>
+    void
+    SharedData<dim>::request_material_model_values ()
+    {
+      material_model_values_requested = true;
+    }
+
+
+
+    template <int dim>
+    const Vector<float> &
+    SharedData<dim>::get_kelly_indicators (const unsigned int block,
+                                           const unsigned int n_face_quadrature_points) const
+    {
+      const typename std::map<std::pair<unsigned int,unsigned int>, Vector<float> >::const_iterator
+      p = kelly_indicators.find (std::make_pair (block, n_face_quadrature_points));
+      Assert (p != kelly_indicators.end(),
+              ExcMessage ("The requested error indicators have not been computed. "
+                          "Did you forget to request them?"));
+      return p->second;
+    }
+
+
+
+    template <int dim>
+    void
+    SharedData<dim>::compute (const SimulatorAccess<dim> &simulator_access)
+    {
+      const DoFHandler<dim> &dof_handler = simulator_access.get_dof_handler();
+      const LinearAlgebra::BlockVector &solution = simulator_access.get_solution();
+      const Introspection<dim> &introspection = simulator_access.introspection();
+      const unsigned int n_active_cells = simulator_access.get_triangulation().n_active_cells();
+
+      // run the KellyErrorEstimator once for each requested combination of
+      // block and quadrature formula, no matter how many criteria have
+      // asked for it. the estimator could work on several vectors at once,
+      // but only with one component mask for all of them, and it needs
+      // vectors that match the DoFHandler of the entire system. we would
+      // therefore need a full copy of the solution for each block, and
+      // instead run it on the solution itself with the mask of the block.
+      // consequently, each requested block costs one loop over all faces,
+      // just as if the criteria computed their indicators themselves
+      for (typename std::map<std::pair<unsigned int,unsigned int>, Vector<float> >::iterator
+           p = kelly_indicators.begin(); p != kelly_indicators.end(); ++p)
+        {
+          const unsigned int block = p->first.first;
+
+          std::vector<bool> mask (introspection.n_components, false);
+          for (unsigned int c=0; c<introspection.n_components; ++c)
+            if (introspection.components_to_blocks[c] == block)
+              mask[c] = true;
+
+          p->second.reinit (n_active_cells);
+          KellyErrorEstimator<dim>::estimate (dof_handler,
+                                              QGauss<dim-1>(p->first.second),
+                                              typename FunctionMap<dim>::type(),
+                                              solution,
+                                              p->second,
+                                              ComponentMask (mask),
+                                              0,
+                                              0,
+                                              simulator_access.get_triangulation().locally_owned_subdomain());
+        }
+
+      // evaluate the material model at the support points of the
+      // temperature element
+      material_model_inputs.clear ();
+      material_model_outputs.clear ();
+      if (material_model_values_requested)
+        {
+          const FiniteElement<dim> &fe = simulator_access.get_fe();
+          const unsigned int n_compositional_fields = simulator_access.n_compositional_fields();
+
+          const Quadrature<dim> quadrature(fe.base_element(2).get_unit_support_points());
+          FEValues<dim> fe_values (simulator_access.get_mapping(),
+                                   fe,
+                                   quadrature,
+                                   update_quadrature_points | update_values);
+
+          // the values of the compositional fields are stored as blockvectors for each field
+          // we have to extract them in this structure
+          std::vector<std::vector<double> > prelim_composition_values (n_compositional_fields,
+                                                                       std::vector<double> (quadrature.size()));
+
+          typename MaterialModel::Interface<dim>::MaterialModelInputs in(quadrature.size(),
+                                                                         n_compositional_fields);
+          typename MaterialModel::Interface<dim>::MaterialModelOutputs out(quadrature.size(),
+                                                                           n_compositional_fields);
+
+          material_model_inputs.reserve (simulator_access.get_triangulation().n_locally_owned_active_cells());
+          material_model_outputs.reserve (simulator_access.get_triangulation().n_locally_owned_active_cells());
+
+          typename DoFHandler<dim>::active_cell_iterator
+          cell = dof_handler.begin_active(),
+          endc = dof_handler.end();
+          for (; cell!=endc; ++cell)
+            if (cell->is_locally_owned())
+              {
+                fe_values.reinit(cell);
+                fe_values[introspection.extractors.pressure].get_function_values (solution,
+                                                                                  in.pressure);
+                fe_values[introspection.extractors.temperature].get_function_values (solution,
+                                                                                     in.temperature);
+                for (unsigned int c=0; c<n_compositional_fields; ++c)
+                  fe_values[introspection.extractors.compositional_fields[c]].get_function_values (solution,
+                      prelim_composition_values[c]);
+
+                in.position = fe_values.get_quadrature_points();
+                in.strain_rate.resize(0);// we are not reading the viscosity
+                for (unsigned int i=0; i<quadrature.size(); ++i)
+                  for (unsigned int c=0; c<n_compositional_fields; ++c)
+                    in.composition[i][c] = prelim_composition_values[c][i];
+
+                simulator_access.get_material_model().evaluate(in, out);
+
+                material_model_inputs.push_back (in);
+                material_model_outputs.push_back (out);
+              }
+        }
+    }
+
+
+
 // ------------------------------ Interface -----------------------------
 
     template <int dim>
@@ -51,6 +199,23 @@ namespace aspect
 
 
 
+    template <int dim>
+    void
+    Interface<dim>::request_shared_data (SharedData<dim> &) const
+    {}
+
+
+
+    template <int dim>
+    void
+    Interface<dim>::execute_with_shared_data (const SharedData<dim> &,
+                                              Vector<float>         &error_indicators) const
+    {
+      execute (error_indicators);
+    }
+
+
+
 // ------------------------------ Manager -----------------------------
 
     template <int dim>
@@ -82,6 +247,8 @@ namespace aspect
       } simulator_access;
       simulator_access.initialize (simulator);
       mpi_communicator = simulator_access.get_mpi_communicator();
+
+      this->simulator = &simulator;
     }
 
 
@@ -92,6 +259,26 @@ namespace aspect
     {
       Assert (mesh_refinement_objects.size() > 0, ExcInternalError());
 
+      Timer timer (mpi_communicator, true);
+      std::vector<double> times;
+
+      // first compute the data that more than one plugin may
+      // need, such as error indicators from the KellyErrorEstimator
+      // or values of the material model, so that we only have to
+      // compute it once
+      SharedData<dim> shared_data;
+      for (typename std::list<std_cxx1x::shared_ptr<Interface<dim> > >::const_iterator
+           p = mesh_refinement_objects.begin();
+           p != mesh_refinement_objects.end(); ++p)
+        (*p)->request_shared_data (shared_data);
+      {
+        SimulatorAccess<dim> simulator_access;
+        simulator_access.initialize (*simulator);
+        shared_data.compute (simulator_access);
+      }
+      timer.stop ();
+      times.push_back (timer.wall_time());
+
       // call the execute() functions of all plugins we have
       // here in turns. then normalize the output vector and
       // verify that its values are non-negative numbers
@@ -102,9 +289,10 @@ namespace aspect
            p = mesh_refinement_objects.begin();
            p != mesh_refinement_objects.end(); ++p, ++index)
         {
+          timer.restart ();
           try
             {
-              (*p)->execute (all_error_indicators[index]);
+              (*p)->execute_with_shared_data (shared_data, all_error_indicators[index]);
 
               for (unsigned int i=0; i<error_indicators.size(); ++i)
                 Assert (all_error_indicators[index](i) >= 0,
@@ -164,6 +352,20 @@ namespace aspect
               // terminate the program!
               MPI_Abort (MPI_COMM_WORLD, 1);
             }
+          timer.stop ();
+          times.push_back (timer.wall_time());
+        }
+
+      if (report_times == true
+          &&
+          Utilities::MPI::this_mpi_process (mpi_communicator) == 0)
+        {
+          std::cout << "   Computing refinement indicators took "
+                    << times[0] << "s for shared data";
+          for (unsigned int i=0; i<mesh_refinement_object_names.size(); ++i)
+            std::cout << ", " << times[i+1] << "s for '"
+                      << mesh_refinement_object_names[i] << "'";
+          std::cout << '.' << std::endl;
         }
 
       // now merge the results
@@ -341,9 +543,14 @@ namespace aspect
           merge_operation = max;
         else
           AssertThrow (false, ExcNotImplemented());
+
+        // this parameter is declared by the Simulator
+        report_times = prm.get_bool ("Report mesh refinement times");
       }
       prm.leave_subsection();
 
+      mesh_refinement_object_names = plugin_names;
+
       // go through the list, create objects and let them parse
       // their own parameters
       AssertThrow (plugin_names.size() >= 1,
@@ -393,6 +600,7 @@ namespace aspect
   namespace MeshRefinement
   {
 #define INSTANTIATE(dim) \
+  template class SharedData<dim>; \
   template class Interface<dim>; \
   template class Manager<dim>;
 
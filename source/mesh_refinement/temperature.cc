@@ -33,18 +33,30 @@ namespace aspect
     void
     Temperature<dim>::execute(Vector<float> &indicators) const
     {
-      indicators = 0;
+      SharedData<dim> shared_data;
+      request_shared_data (shared_data);
+      shared_data.compute (*this);
+      execute_with_shared_data (shared_data, indicators);
+    }
+
 
-      KellyErrorEstimator<dim>::estimate (this->get_dof_handler(),
+
+    template <int dim>
+    void
+    Temperature<dim>::request_shared_data (SharedData<dim> &shared_data) const
+    {
 //TODO: Replace the 3 by something reasonable, adjusted to the polynomial degree
-                                          QGauss<dim-1>(3),
-                                          typename FunctionMap<dim>::type(),
-                                          this->get_solution(),
-                                          indicators,
-                                          this->introspection().component_masks.temperature,
-                                          0,
-                                          0,
-                                          this->get_triangulation().locally_owned_subdomain());
+      shared_data.request_kelly_indicators (this->introspection().block_indices.temperature, 3);
+    }
+
+
+
+    template <int dim>
+    void
+    Temperature<dim>::execute_with_shared_data (const SharedData<dim> &shared_data,
+                                                Vector<float>         &indicators) const
+    {
+      indicators = shared_data.get_kelly_indicators (this->introspection().block_indices.temperature, 3);
     }
   }
 }
@@ -34,69 +34,61 @@ namespace aspect
     template <int dim>
     void
     ThermalEnergyDensity<dim>::execute(Vector<float> &indicators) const
+    {
+      SharedData<dim> shared_data;
+      request_shared_data (shared_data);
+      shared_data.compute (*this);
+      execute_with_shared_data (shared_data, indicators);
+    }
+
+
+
+    template <int dim>
+    void
+    ThermalEnergyDensity<dim>::request_shared_data (SharedData<dim> &shared_data) const
+    {
+      shared_data.request_material_model_values ();
+    }
+
+
+
+    template <int dim>
+    void
+    ThermalEnergyDensity<dim>::execute_with_shared_data (const SharedData<dim> &shared_data,
+                                                         Vector<float>         &indicators) const
     {
       indicators = 0;
 
       // create a vector in which we set the temperature block to
       // be a finite element interpolation of the thermal energy density
-      // rho*c_p*T. we do so by setting up a quadrature formula with the
-      // temperature unit support points, then looping over these
-      // points, compute the output quantity at them, and writing
-      // the result into the output vector in the same order
-      // (because quadrature points and temperature dofs are,
-      // by design of the quadrature formula, numbered in the
-      // same way)
+      // rho*c_p*T. the material model has already been evaluated at the
+      // temperature unit support points on all cells when computing
+      // the shared data, so we only need to write the result into
+      // the output vector in the same order (because quadrature
+      // points and temperature dofs are, by design of the quadrature
+      // formula, numbered in the same way)
       LinearAlgebra::BlockVector vec_distributed (this->introspection().index_sets.system_partitioning,
                                                   this->get_mpi_communicator());
 
-      const Quadrature<dim> quadrature(this->get_fe().base_element(2).get_unit_support_points());
       std::vector<types::global_dof_index> local_dof_indices (this->get_fe().dofs_per_cell);
-      FEValues<dim> fe_values (this->get_mapping(),
-                               this->get_fe(),
-                               quadrature,
-                               update_quadrature_points | update_values);
-      std::vector<double> pressure_values(quadrature.size());
-      std::vector<double> temperature_values(quadrature.size());
-
-      // the values of the compositional fields are stored as blockvectors for each field
-      // we have to extract them in this structure
-      std::vector<std::vector<double> > prelim_composition_values (this->n_compositional_fields(),
-                                                                   std::vector<double> (quadrature.size()));
-      std::vector<std::vector<double> > composition_values (quadrature.size(),
-                                                            std::vector<double> (this->n_compositional_fields()));
-
-      typename MaterialModel::Interface<dim>::MaterialModelInputs in(quadrature.size(), this->n_compositional_fields());
-      typename MaterialModel::Interface<dim>::MaterialModelOutputs out(quadrature.size(), this->n_compositional_fields());
 
       typename DoFHandler<dim>::active_cell_iterator
       cell = this->get_dof_handler().begin_active(),
       endc = this->get_dof_handler().end();
+      unsigned int cell_index = 0;
       for (; cell!=endc; ++cell)
         if (cell->is_locally_owned())
           {
-            fe_values.reinit(cell);
-            fe_values[this->introspection().extractors.pressure].get_function_values (this->get_solution(),
-                                                                                      pressure_values);
-            fe_values[this->introspection().extractors.temperature].get_function_values (this->get_solution(),
-                                                                                         temperature_values);
-            for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-              fe_values[this->introspection().extractors.compositional_fields[c]].get_function_values (this->get_solution(),
-                  prelim_composition_values[c]);
+            const typename MaterialModel::Interface<dim>::MaterialModelInputs &in
+              = shared_data.material_model_inputs[cell_index];
+            const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out
+              = shared_data.material_model_outputs[cell_index];
+            ++cell_index;
 
             cell->get_dof_indices (local_dof_indices);
-            in.position = fe_values.get_quadrature_points();
-            in.strain_rate.resize(0);// we are not reading the viscosity
-            for (unsigned int i=0; i<quadrature.size(); ++i)
-              {
-                in.temperature[i] = temperature_values[i];
-                in.pressure[i] = pressure_values[i];
-                for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-                  in.composition[i][c] = prelim_composition_values[c][i];
-              }
-            this->get_material_model().evaluate(in, out);
 
             // for each temperature dof, write into the output
-            // vector the density. note that quadrature points and
+            // vector the thermal energy density. note that quadrature points and
             // dofs are enumerated in the same order
             for (unsigned int i=0; i<this->get_fe().base_element(2).dofs_per_cell; ++i)
               {
@@ -106,11 +98,13 @@ namespace aspect
 
                 vec_distributed(local_dof_indices[system_local_dof])
                   = out.densities[i]
-                    * temperature_values[i]
+                    * in.temperature[i]
                     * out.specific_heat[i];
               }
           }
 
+      vec_distributed.compress(VectorOperation::insert);
+
       // now create a vector with the requisite ghost elements
       // and use it for estimating the gradients
       LinearAlgebra::BlockVector vec (this->introspection().index_sets.system_relevant_partitioning,
@@ -33,17 +33,31 @@ namespace aspect
     void
     Velocity<dim>::execute(Vector<float> &indicators) const
     {
-      indicators = 0;
-
-      KellyErrorEstimator<dim>::estimate (this->get_dof_handler(),
-                                          QGauss<dim-1>(this->get_fe().base_element(0).degree+1),
-                                          typename FunctionMap<dim>::type(),
-                                          this->get_solution(),
-                                          indicators,
-                                          this->introspection().component_masks.velocities,
-                                          0,
-                                          0,
-                                          this->get_triangulation().locally_owned_subdomain());
+      SharedData<dim> shared_data;
+      request_shared_data (shared_data);
+      shared_data.compute (*this);
+      execute_with_shared_data (shared_data, indicators);
+    }
+
+
+
+    template <int dim>
+    void
+    Velocity<dim>::request_shared_data (SharedData<dim> &shared_data) const
+    {
+      shared_data.request_kelly_indicators (this->introspection().block_indices.velocities,
+                                            this->get_fe().base_element(0).degree+1);
+    }
+
+
+
+    template <int dim>
+    void
+    Velocity<dim>::execute_with_shared_data (const SharedData<dim> &shared_data,
+                                             Vector<float>         &indicators) const
+    {
+      indicators = shared_data.get_kelly_indicators (this->introspection().block_indices.velocities,
+                                                     this->get_fe().base_element(0).degree+1);
     }
   }
 }
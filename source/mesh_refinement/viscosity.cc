@@ -34,66 +34,59 @@ namespace aspect
     template <int dim>
     void
     Viscosity<dim>::execute(Vector<float> &indicators) const
+    {
+      SharedData<dim> shared_data;
+      request_shared_data (shared_data);
+      shared_data.compute (*this);
+      execute_with_shared_data (shared_data, indicators);
+    }
+
+
+
+    template <int dim>
+    void
+    Viscosity<dim>::request_shared_data (SharedData<dim> &shared_data) const
+    {
+      shared_data.request_material_model_values ();
+    }
+
+
+
+    template <int dim>
+    void
+    Viscosity<dim>::execute_with_shared_data (const SharedData<dim> &shared_data,
+                                              Vector<float>         &indicators) const
     {
       indicators = 0;
 
 //TODO: if the viscosity doesn't actually depend on the solution
       // then we can get away with simply interpolating it spatially
 
-
       // create a vector in which we set the temperature block to
       // be a finite element interpolation of the viscosity.
-      // we do so by setting up a quadrature formula with the
-      // temperature unit support points, then looping over these
-      // points, compute the output quantity at them, and writing
-      // the result into the output vector in the same order
-      // (because quadrature points and temperature dofs are,
-      // by design of the quadrature formula, numbered in the
-      // same way)
+      // the material model has already been evaluated at the
+      // temperature unit support points on all cells when computing
+      // the shared data, so we only need to write the result into
+      // the output vector in the same order (because quadrature
+      // points and temperature dofs are, by design of the quadrature
+      // formula, numbered in the same way)
       LinearAlgebra::BlockVector vec_distributed (this->introspection().index_sets.system_partitioning,
                                                   this->get_mpi_communicator());
 
-      const Quadrature<dim> quadrature(this->get_fe().base_element(2).get_unit_support_points());
-      std::vector<unsigned int> local_dof_indices (this->get_fe().dofs_per_cell);
-      FEValues<dim> fe_values (this->get_mapping(),
-                               this->get_fe(),
-                               quadrature,
-                               update_quadrature_points | update_values);
-
-      // the values of the compositional fields are stored as blockvectors for each field
-      // we have to extract them in this structure
-      std::vector<std::vector<double> > prelim_composition_values (this->n_compositional_fields(),
-                                                                   std::vector<double> (quadrature.size()));
-
-      typename MaterialModel::Interface<dim>::MaterialModelInputs in(quadrature.size(),
-                                                                     this->n_compositional_fields());
-      typename MaterialModel::Interface<dim>::MaterialModelOutputs out(quadrature.size(),
-                                                                       this->n_compositional_fields());
+      std::vector<types::global_dof_index> local_dof_indices (this->get_fe().dofs_per_cell);
 
       typename DoFHandler<dim>::active_cell_iterator
       cell = this->get_dof_handler().begin_active(),
       endc = this->get_dof_handler().end();
+      unsigned int cell_index = 0;
       for (; cell!=endc; ++cell)
         if (cell->is_locally_owned())
           {
-            fe_values.reinit(cell);
-
-            fe_values[this->introspection().extractors.pressure].get_function_values (this->get_solution(),
-                                                                                      in.pressure);
-            fe_values[this->introspection().extractors.temperature].get_function_values (this->get_solution(),
-                                                                                         in.temperature);
-            for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-              fe_values[this->introspection().extractors.compositional_fields[c]].get_function_values (this->get_solution(),
-                  prelim_composition_values[c]);
-
-            in.position = fe_values.get_quadrature_points();
-            in.strain_rate.resize(0);// we are not reading the viscosity
-            for (unsigned int i=0; i<quadrature.size(); ++i)
-              {
-                for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-                  in.composition[i][c] = prelim_composition_values[c][i];
-              }
-            this->get_material_model().evaluate(in, out);
+            const typename MaterialModel::Interface<dim>::MaterialModelInputs &in
+              = shared_data.material_model_inputs[cell_index];
+            const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out
+              = shared_data.material_model_outputs[cell_index];
+            ++cell_index;
 
             cell->get_dof_indices (local_dof_indices);
 
@@ -111,6 +104,8 @@ namespace aspect
               }
           }
 
+      vec_distributed.compress(VectorOperation::insert);
+
       // now create a vector with the requisite ghost elements
       // and use it for estimating the gradients
       LinearAlgebra::BlockVector vec (this->introspection().index_sets.system_relevant_partitioning,
@@ -79,17 +79,28 @@ namespace aspect
       data_point.values.resize(n_statistics, std::vector<double> (n_depth_zones));
 
       // add temperature and the compositional fields that follow
-      // it immediately
+      // it immediately. all quantities except for the adiabatic
+      // temperature are computed in a single pass over the mesh
       {
-        this->get_depth_average_temperature(data_point.values[0]);
+        std::vector<std::string> quantities;
+        quantities.push_back ("temperature");
         for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-          this->get_depth_average_composition(c, data_point.values[1+c]);
+          quantities.push_back ("C_" + Utilities::int_to_string(c));
+        quantities.push_back ("velocity magnitude");
+        quantities.push_back ("sinking velocity");
+        quantities.push_back ("Vs");
+        quantities.push_back ("Vp");
+        quantities.push_back ("viscosity");
+
+        std::vector<std::vector<double> > averages (quantities.size(),
+                                                    std::vector<double> (n_depth_zones));
+        this->get_depth_averages (quantities, averages);
+
+        for (unsigned int c=0; c<1+this->n_compositional_fields(); ++c)
+          data_point.values[c] = averages[c];
         this->get_adiabatic_conditions().get_adiabatic_temperature_profile(data_point.values[1+this->n_compositional_fields()]);
-        this->get_depth_average_velocity_magnitude(data_point.values[2+this->n_compositional_fields()]);
-        this->get_depth_average_sinking_velocity(data_point.values[3+this->n_compositional_fields()]);
-        this->get_depth_average_Vs(data_point.values[4+this->n_compositional_fields()]);
-        this->get_depth_average_Vp(data_point.values[5+this->n_compositional_fields()]);
-        this->get_depth_average_viscosity(data_point.values[6+this->n_compositional_fields()]);
+        for (unsigned int i=1+this->n_compositional_fields(); i<quantities.size(); ++i)
+          data_point.values[i+1] = averages[i];
       }
       entries.push_back (data_point);
 
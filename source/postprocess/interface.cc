@@ -23,13 +23,76 @@
 #include <aspect/postprocess/interface.h>
 #include <aspect/simulator_access.h>
 
+#include <deal.II/base/timer.h>
+
+#include <boost/serialization/map.hpp>
+#include <boost/serialization/string.hpp>
+
 #include <typeinfo>
+#include <limits>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
 
 
 namespace aspect
 {
+  namespace internal
+  {
+    /**
+     * A class that gives the postprocessor manager access to the few
+     * properties of the simulator it needs to decide which postprocessors
+     * to run.
+     */
+    template <int dim>
+    class PostprocessManagerAccess : public SimulatorAccess<dim>
+    {
+      public:
+        using SimulatorAccess<dim>::get_time;
+        using SimulatorAccess<dim>::get_timestep_number;
+        using SimulatorAccess<dim>::convert_output_to_years;
+        using SimulatorAccess<dim>::get_mpi_communicator;
+    };
+  }
+
+
   namespace Postprocess
   {
+    namespace
+    {
+      /**
+       * Parse a comma separated list of entries of the form 'name: value'
+       * and return the map from names to values. Every name needs to be one
+       * of the given postprocessor names.
+       */
+      std::map<std::string,double>
+      parse_postprocessor_value_list (const std::string              &list,
+                                      const std::vector<std::string> &postprocessor_names,
+                                      const std::string              &parameter_name)
+      {
+        std::map<std::string,double> values;
+
+        const std::vector<std::string> entries = Utilities::split_string_list (list);
+        for (unsigned int i=0; i<entries.size(); ++i)
+          {
+            const std::vector<std::string> parts = Utilities::split_string_list (entries[i], ':');
+            AssertThrow ((parts.size() == 2)
+                         &&
+                         (std::find (postprocessor_names.begin(),
+                                     postprocessor_names.end(),
+                                     parts[0]) != postprocessor_names.end()),
+                         ExcMessage ("The entry <" + entries[i] + "> of the parameter <"
+                                     + parameter_name + "> does not have the form "
+                                     "'postprocessor name: value', or the postprocessor "
+                                     "it refers to has not been selected."));
+            values[parts[0]] = Utilities::string_to_double (parts[1]);
+          }
+
+        return values;
+      }
+    }
+
+
 // ------------------------------ Interface -----------------------------
 
     template <int dim>
@@ -74,6 +137,42 @@ namespace aspect
            p = postprocessors.begin();
            p != postprocessors.end(); ++p)
         dynamic_cast<SimulatorAccess<dim>&>(**p).initialize (simulator);
+
+      simulator_access.reset (new aspect::internal::PostprocessManagerAccess<dim>());
+      simulator_access->initialize (simulator);
+    }
+
+
+
+    template <int dim>
+    bool
+    Manager<dim>::execute_in_this_step (const unsigned int index)
+    {
+      if ((step_intervals[index] > 0)
+          &&
+          (simulator_access->get_timestep_number() % step_intervals[index] != 0))
+        return false;
+
+      if (time_intervals[index] > 0)
+        {
+          const double time = simulator_access->get_time();
+
+          // if this is the first time we get here, always execute
+          if (!std::isnan(next_execution_times[index])
+              &&
+              (time < next_execution_times[index]))
+            return false;
+
+          // the current time is always in seconds, so we need to convert the
+          // interval to the same unit. then compute the next time as the
+          // smallest multiple of the interval larger than the current time
+          const double interval_in_s = (simulator_access->convert_output_to_years() ?
+                                        time_intervals[index]*year_in_seconds :
+                                        time_intervals[index]);
+          next_execution_times[index] = (std::floor(time/interval_in_s)+1.0) * interval_in_s;
+        }
+
+      return true;
     }
 
 
@@ -85,12 +184,20 @@ namespace aspect
       // call the execute() functions of all postprocessor objects we have
       // here in turns
       std::list<std::pair<std::string,std::string> > output_list;
+      unsigned int index = 0;
       for (typename std::list<std_cxx1x::shared_ptr<Interface<dim> > >::iterator
            p = postprocessors.begin();
-           p != postprocessors.end(); ++p)
+           p != postprocessors.end(); ++p, ++index)
         {
+          // skip postprocessors that are not supposed to run in
+          // this time step
+          if (execute_in_this_step (index) == false)
+            continue;
+
           try
             {
+              Timer timer;
+
               // call the execute() function. if it produces any output
               // then add it to the list
               std::pair<std::string,std::string> output
@@ -98,6 +205,21 @@ namespace aspect
 
               if (output.first.size() + output.second.size() > 0)
                 output_list.push_back (output);
+
+              // if so requested, record the time this postprocessor took
+              // on the slowest processor
+              if (record_postprocessor_times)
+                {
+                  timer.stop ();
+                  const std::string column_name = "Postprocessing time for '"
+                                                  + postprocessor_names[index]
+                                                  + "' (s)";
+                  statistics.add_value (column_name,
+                                        Utilities::MPI::max (timer.wall_time(),
+                                                             simulator_access->get_mpi_communicator()));
+                  statistics.set_precision (column_name, 4);
+                  statistics.set_scientific (column_name, true);
+                }
             }
           // postprocessors that throw exceptions usually do not result in
           // anything good because they result in an unwinding of the stack
@@ -185,6 +307,39 @@ namespace aspect
                           "The following postprocessors are available:\n\n"
                           +
                           std_cxx1x::get<dim>(registered_plugins).get_description_string());
+
+        prm.declare_entry("Postprocessor step intervals",
+                          "",
+                          Patterns::Anything(),
+                          "A comma separated list of entries of the form "
+                          "'postprocessor name: n' that indicate that the named "
+                          "postprocessor should only be run every n time steps, "
+                          "i.e., in those time steps whose number is divisible by n. "
+                          "Postprocessors not listed here are run in every time step. "
+                          "This allows running cheap postprocessors in every time step "
+                          "while expensive ones are run less often.");
+        prm.declare_entry("Postprocessor time intervals",
+                          "",
+                          Patterns::Anything(),
+                          "A comma separated list of entries of the form "
+                          "'postprocessor name: t' that indicate that the named "
+                          "postprocessor should only be run once in every time interval "
+                          "of length t, as well as in the first time step. If a "
+                          "postprocessor is also listed in 'Postprocessor step "
+                          "intervals', both conditions need to be satisfied. Note that "
+                          "some postprocessors, such as the ones that generate graphical "
+                          "output, have their own parameters that determine how often "
+                          "they produce output. "
+                          "Units: years if the "
+                          "'Use years in output instead of seconds' parameter is set; "
+                          "seconds otherwise.");
+        prm.declare_entry("Record postprocessor times",
+                          "false",
+                          Patterns::Bool(),
+                          "Whether the wall time each postprocessor takes should be "
+                          "recorded in the statistics file, in one column per "
+                          "postprocessor. The time recorded is the maximum over all "
+                          "processors.");
       }
       prm.leave_subsection();
 
@@ -203,11 +358,14 @@ namespace aspect
               ExcMessage ("No postprocessors registered!?"));
 
       // first find out which postprocessors are requested
-      std::vector<std::string> postprocessor_names;
+      std::string step_interval_list, time_interval_list;
       prm.enter_subsection("Postprocess");
       {
         postprocessor_names
           = Utilities::split_string_list(prm.get("List of postprocessors"));
+        step_interval_list = prm.get("Postprocessor step intervals");
+        time_interval_list = prm.get("Postprocessor time intervals");
+        record_postprocessor_times = prm.get_bool("Record postprocessor times");
       }
       prm.leave_subsection();
 
@@ -232,6 +390,82 @@ namespace aspect
                                    .create_plugin (postprocessor_names[name],
                                                    "Postprocessor plugins",
                                                    prm)));
+
+      // finally determine how often each of them is to be run
+      const std::map<std::string,double> step_interval_map
+        = parse_postprocessor_value_list (step_interval_list, postprocessor_names,
+                                          "Postprocessor step intervals");
+      const std::map<std::string,double> time_interval_map
+        = parse_postprocessor_value_list (time_interval_list, postprocessor_names,
+                                          "Postprocessor time intervals");
+
+      step_intervals.resize (postprocessor_names.size(), 0);
+      time_intervals.resize (postprocessor_names.size(), 0);
+      next_execution_times.resize (postprocessor_names.size(),
+                                   std::numeric_limits<double>::quiet_NaN());
+      for (unsigned int name=0; name<postprocessor_names.size(); ++name)
+        {
+          if (step_interval_map.find (postprocessor_names[name]) != step_interval_map.end())
+            {
+              const double n = step_interval_map.find (postprocessor_names[name])->second;
+              AssertThrow ((n >= 1) && (n == static_cast<unsigned int>(n)),
+                           ExcMessage ("The step interval for postprocessor <"
+                                       + postprocessor_names[name]
+                                       + "> needs to be a positive integer."));
+              step_intervals[name] = static_cast<unsigned int>(n);
+            }
+
+          if (time_interval_map.find (postprocessor_names[name]) != time_interval_map.end())
+            {
+              time_intervals[name] = time_interval_map.find (postprocessor_names[name])->second;
+              AssertThrow (time_intervals[name] >= 0,
+                           ExcMessage ("The time interval for postprocessor <"
+                                       + postprocessor_names[name]
+                                       + "> can not be negative."));
+            }
+        }
+    }
+
+
+
+    template <int dim>
+    void
+    Manager<dim>::save_schedule (std::map<std::string,std::string> &saved_text) const
+    {
+      std::ostringstream os;
+      aspect::oarchive oa (os);
+
+      // store the next execution times by postprocessor name so that we can
+      // restore them even if the set of postprocessors has changed upon
+      // restart
+      std::map<std::string,double> next_times;
+      for (unsigned int i=0; i<postprocessor_names.size(); ++i)
+        if (!std::isnan(next_execution_times[i]))
+          next_times[postprocessor_names[i]] = next_execution_times[i];
+      oa << next_times;
+
+      saved_text["PostprocessManager"] = os.str();
+    }
+
+
+
+    template <int dim>
+    void
+    Manager<dim>::load_schedule (const std::map<std::string,std::string> &saved_text)
+    {
+      // see if something was saved
+      if (saved_text.find("PostprocessManager") == saved_text.end())
+        return;
+
+      std::istringstream is (saved_text.find("PostprocessManager")->second);
+      aspect::iarchive ia (is);
+
+      std::map<std::string,double> next_times;
+      ia >> next_times;
+
+      for (unsigned int i=0; i<postprocessor_names.size(); ++i)
+        if (next_times.find (postprocessor_names[i]) != next_times.end())
+          next_execution_times[i] = next_times.find (postprocessor_names[i])->second;
     }
 
 
@@ -0,0 +1,471 @@
+/*
+  Copyright (C) 2014 by the authors of the ASPECT code.
+
+  This file is part of ASPECT.
+
+  ASPECT is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  ASPECT is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ASPECT; see the file doc/COPYING.  If not see
+  <http://www.gnu.org/licenses/>.
+*/
+/*  $Id$  */
+
+
+#include <aspect/postprocess/surface_visualization.h>
+#include <aspect/simulator_access.h>
+#include <aspect/global.h>
+
+#include <deal.II/numerics/data_out_faces.h>
+#include <deal.II/numerics/data_postprocessor.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <math.h>
+#include <fstream>
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    namespace
+    {
+      /**
+       * A version of DataOutFaces that only generates patches for the
+       * faces of locally owned cells that are on those parts of the
+       * boundary that have one of the given boundary indicators. If the
+       * set of boundary indicators is empty, all boundary faces are
+       * selected.
+       */
+      template <int dim>
+      class BoundaryDataOutFaces : public DataOutFaces<dim>
+      {
+        public:
+          typedef typename DataOutFaces<dim>::FaceDescriptor FaceDescriptor;
+
+          BoundaryDataOutFaces (const std::set<types::boundary_id> &boundary_indicators)
+            :
+            boundary_indicators (boundary_indicators)
+          {}
+
+          virtual
+          FaceDescriptor
+          first_face ()
+          {
+            typename Triangulation<dim>::active_cell_iterator
+            cell = this->triangulation->begin_active();
+            return next_selected_face (cell, 0);
+          }
+
+          virtual
+          FaceDescriptor
+          next_face (const FaceDescriptor &face)
+          {
+            typename Triangulation<dim>::active_cell_iterator
+            cell = face.first;
+            return next_selected_face (cell, face.second+1);
+          }
+
+        private:
+          const std::set<types::boundary_id> boundary_indicators;
+
+          /**
+           * Return the first selected face, starting with face number
+           * @p face_no of the given cell, then continuing with all faces of
+           * the following active cells.
+           */
+          FaceDescriptor
+          next_selected_face (typename Triangulation<dim>::active_cell_iterator cell,
+                              unsigned int face_no) const
+          {
+            for (; cell != this->triangulation->end(); ++cell, face_no=0)
+              if (cell->is_locally_owned() && cell->at_boundary())
+                for (; face_no<GeometryInfo<dim>::faces_per_cell; ++face_no)
+                  if (cell->face(face_no)->at_boundary()
+                      &&
+                      (boundary_indicators.empty()
+                       ||
+                       (boundary_indicators.find (cell->face(face_no)->boundary_indicator())
+                        != boundary_indicators.end())))
+                    return FaceDescriptor (cell, face_no);
+
+            return FaceDescriptor (this->triangulation->end(), 0);
+          }
+      };
+
+
+      /**
+       * A postprocessor that extracts the velocity components from a
+       * vector that has the layout of the solution vector. We use this to
+       * output the velocity with which the mesh moves.
+       */
+      template <int dim>
+      class MeshVelocityOutput : public DataPostprocessorVector<dim>
+      {
+        public:
+          MeshVelocityOutput ()
+            :
+            DataPostprocessorVector<dim> ("mesh_velocity",
+                                          update_values)
+          {}
+
+          virtual
+          void
+          compute_derived_quantities_vector (const std::vector<Vector<double> >              &uh,
+                                             const std::vector<std::vector<Tensor<1,dim> > > &,
+                                             const std::vector<std::vector<Tensor<2,dim> > > &,
+                                             const std::vector<Point<dim> > &,
+                                             const std::vector<Point<dim> > &,
+                                             std::vector<Vector<double> >                    &computed_quantities) const
+          {
+            for (unsigned int q=0; q<uh.size(); ++q)
+              for (unsigned int d=0; d<dim; ++d)
+                computed_quantities[q](d) = uh[q][d];
+          }
+      };
+    }
+
+
+
+    template <int dim>
+    SurfaceVisualization<dim>::SurfaceVisualization ()
+      :
+      // the following value is later read from the input file
+      output_interval (0),
+      // initialize this to a nonsensical value; set it to the actual time
+      // the first time around we get to check it
+      next_output_time (std::numeric_limits<double>::quiet_NaN()),
+      output_file_number (0)
+    {}
+
+
+
+    template <int dim>
+    std::pair<std::string,std::string>
+    SurfaceVisualization<dim>::execute (TableHandler &statistics)
+    {
+      // if this is the first time we get here, set the next output time
+      // to the current time. this makes sure we always produce data during
+      // the first time step
+      if (std::isnan(next_output_time))
+        next_output_time = this->get_time();
+
+      // see if graphical output is requested at this time
+      if (this->get_time() < next_output_time)
+        return std::pair<std::string,std::string>();
+
+      // if no boundary indicators were given, use the free surface
+      // (if there is one) or the entire boundary (if there is none,
+      // indicated by an empty set)
+      const std::set<types::boundary_id> output_boundary_indicators
+        = (boundary_indicators.empty()
+           ?
+           this->get_free_surface_boundary_indicators()
+           :
+           boundary_indicators);
+
+      // the object that extracts the mesh velocity needs to live longer
+      // than the DataOutFaces object that will store a pointer to it
+      const MeshVelocityOutput<dim> mesh_velocity_output;
+
+      BoundaryDataOutFaces<dim> data_out (output_boundary_indicators);
+      data_out.attach_dof_handler (this->get_dof_handler());
+
+      // add the primary variables
+      std::vector<std::string> solution_names (dim, "velocity");
+      solution_names.push_back ("p");
+      solution_names.push_back ("T");
+      for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
+        solution_names.push_back ("C_" + boost::lexical_cast<std::string>(c+1));
+
+      std::vector<DataComponentInterpretation::DataComponentInterpretation>
+      interpretation (dim,
+                      DataComponentInterpretation::component_is_part_of_vector);
+      interpretation.push_back (DataComponentInterpretation::component_is_scalar);
+      interpretation.push_back (DataComponentInterpretation::component_is_scalar);
+      for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
+        interpretation.push_back (DataComponentInterpretation::component_is_scalar);
+
+      data_out.add_data_vector (this->get_solution(),
+                                solution_names,
+                                DataOutFaces<dim>::type_dof_data,
+                                interpretation);
+
+      // if we have a free surface, also output the velocity with which
+      // the mesh moves
+      if (this->get_free_surface_boundary_indicators().empty() == false)
+        data_out.add_data_vector (this->get_mesh_velocity(),
+                                  mesh_velocity_output);
+
+      // then for each additional selected output variable add the computed
+      // quantity as well. we have made sure in parse_parameters() that all
+      // of them are derived from DataPostprocessor
+      for (typename std::list<std_cxx1x::shared_ptr<VisualizationPostprocessors::Interface<dim> > >::const_iterator
+           p = postprocessors.begin(); p!=postprocessors.end(); ++p)
+        data_out.add_data_vector (this->get_solution(),
+                                  dynamic_cast<const DataPostprocessor<dim>&>(**p));
+
+      data_out.build_patches (this->get_mapping());
+
+      const std::string solution_file_prefix = "surface-" + Utilities::int_to_string (output_file_number, 5);
+
+      // every processor writes its own file. these are small compared to
+      // the files written for the entire volume, so we don't bother to
+      // write them in the background
+      {
+        const std::string filename = (this->get_output_directory() +
+                                      solution_file_prefix +
+                                      "." +
+                                      Utilities::int_to_string
+                                      (this->get_triangulation().locally_owned_subdomain(), 4) +
+                                      ".vtu");
+        std::ofstream output (filename.c_str());
+        AssertThrow (output, ExcMessage(std::string("Trying to write to file <") +
+                                        filename +
+                                        "> but the file can't be opened!"));
+
+        DataOutBase::VtkFlags vtk_flags;
+#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) >= 704
+        vtk_flags.cycle = this->get_timestep_number();
+        vtk_flags.time = this->get_time();
+#endif
+        data_out.set_flags (vtk_flags);
+        data_out.write_vtu (output);
+      }
+
+      // let the master processor write the master record for all the
+      // distributed files
+      if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
+        {
+          std::vector<std::string> filenames;
+          for (unsigned int i=0; i<Utilities::MPI::n_mpi_processes(this->get_mpi_communicator()); ++i)
+            filenames.push_back (solution_file_prefix +
+                                 "." +
+                                 Utilities::int_to_string(i, 4) +
+                                 ".vtu");
+          const std::string
+          pvtu_master_filename = (solution_file_prefix +
+                                  ".pvtu");
+          std::ofstream pvtu_master ((this->get_output_directory() +
+                                      pvtu_master_filename).c_str());
+          data_out.write_pvtu_record (pvtu_master, filenames);
+
+          // now also generate a .pvd file that matches simulation
+          // time and corresponding .pvtu record
+          times_and_pvtu_names.push_back(std::pair<double,std::string>
+                                         (this->get_time(), pvtu_master_filename));
+          const std::string
+          pvd_master_filename = (this->get_output_directory() + "surface.pvd");
+          std::ofstream pvd_master (pvd_master_filename.c_str());
+          data_out.write_pvd_record (pvd_master, times_and_pvtu_names);
+        }
+
+      // record the file base file name in the output file
+      statistics.add_value ("Surface visualization file name",
+                            this->get_output_directory() + solution_file_prefix);
+
+      // up the counter of the number of the file by one; also
+      // up the next time we need output
+      ++output_file_number;
+      set_next_output_time (this->get_time());
+
+      // return what should be printed to the screen.
+      return std::make_pair (std::string ("Writing surface output:"),
+                             this->get_output_directory() + solution_file_prefix);
+    }
+
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::declare_parameters (ParameterHandler &prm)
+    {
+      prm.enter_subsection("Postprocess");
+      {
+        prm.enter_subsection("Surface visualization");
+        {
+          prm.declare_entry ("Time between graphical output", "1e8",
+                             Patterns::Double (0),
+                             "The time interval between each generation of "
+                             "graphical output files of the surface. A value of "
+                             "zero indicates that output should be generated in "
+                             "each time step. "
+                             "Units: years if the "
+                             "'Use years in output instead of seconds' parameter is set; "
+                             "seconds otherwise.");
+          prm.declare_entry ("Boundary indicators", "",
+                             Patterns::List (Patterns::Integer(0, std::numeric_limits<types::boundary_id>::max())),
+                             "A comma separated list of integers denoting those boundaries "
+                             "on which graphical output should be generated. If this list "
+                             "is empty, output is generated on the free surface if the model "
+                             "has one, and on the entire boundary otherwise.");
+          prm.declare_entry("List of output variables",
+                            "",
+                            Patterns::MultipleSelection(Visualization<dim>::get_names_of_visualization_postprocessors()),
+                            "A comma separated list of visualization objects that should be run "
+                            "whenever writing graphical output of the surface. By default, "
+                            "the output files contain the primary variables velocity, "
+                            "pressure, temperature and compositional fields, as well as the "
+                            "velocity of the mesh if the model has a free surface. The "
+                            "objects that can be selected here are the same as in the "
+                            "'Visualization' section and use the parameters given there, "
+                            "but only those that compute point-wise quantities can be used. "
+                            "Objects that compute one value per cell are not supported.");
+        }
+        prm.leave_subsection();
+      }
+      prm.leave_subsection();
+    }
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::parse_parameters (ParameterHandler &prm)
+    {
+      std::vector<std::string> viz_names;
+
+      prm.enter_subsection("Postprocess");
+      {
+        prm.enter_subsection("Surface visualization");
+        {
+          output_interval = prm.get_double ("Time between graphical output");
+
+          const std::vector<int> x_boundary_indicators
+            = Utilities::string_to_int
+              (Utilities::split_string_list(prm.get ("Boundary indicators")));
+          boundary_indicators
+            = std::set<types::boundary_id> (x_boundary_indicators.begin(),
+                                            x_boundary_indicators.end());
+
+          viz_names = Utilities::split_string_list(prm.get("List of output variables"));
+        }
+        prm.leave_subsection();
+      }
+      prm.leave_subsection();
+
+      // then go through the list, create objects and let them parse
+      // their own parameters
+      for (unsigned int name=0; name<viz_names.size(); ++name)
+        {
+          VisualizationPostprocessors::Interface<dim> *
+          viz_postprocessor = Visualization<dim>::create_visualization_postprocessor (viz_names[name],
+                                                                                     prm);
+
+          AssertThrow (dynamic_cast<DataPostprocessor<dim>*>(viz_postprocessor) != 0,
+                       ExcMessage ("The visualization postprocessor <" + viz_names[name] +
+                                   "> computes one value per cell and can therefore not "
+                                   "be used for graphical output of the surface."));
+
+          postprocessors.push_back (std_cxx1x::shared_ptr<VisualizationPostprocessors::Interface<dim> >
+                                    (viz_postprocessor));
+        }
+    }
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::initialize (const Simulator<dim> &simulator)
+    {
+      // first call the respective function in the base class
+      SimulatorAccess<dim>::initialize (simulator);
+
+      // pass initialization through to the various visualization
+      // objects if they so desire
+      for (typename std::list<std_cxx1x::shared_ptr<VisualizationPostprocessors::Interface<dim> > >::iterator
+           p = postprocessors.begin();
+           p != postprocessors.end(); ++p)
+        if (SimulatorAccess<dim> *x = dynamic_cast<SimulatorAccess<dim>*>(& **p))
+          x->initialize (simulator);
+    }
+
+
+    template <int dim>
+    template <class Archive>
+    void SurfaceVisualization<dim>::serialize (Archive &ar, const unsigned int)
+    {
+      ar &next_output_time
+      & output_file_number
+      & times_and_pvtu_names;
+    }
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::save (std::map<std::string, std::string> &status_strings) const
+    {
+      std::ostringstream os;
+      aspect::oarchive oa (os);
+      oa << (*this);
+
+      status_strings["SurfaceVisualization"] = os.str();
+    }
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::load (const std::map<std::string, std::string> &status_strings)
+    {
+      // see if something was saved
+      if (status_strings.find("SurfaceVisualization") != status_strings.end())
+        {
+          std::istringstream is (status_strings.find("SurfaceVisualization")->second);
+          aspect::iarchive ia (is);
+          ia >> (*this);
+        }
+
+      // set next output time to something useful
+      set_next_output_time (this->get_time());
+    }
+
+
+    template <int dim>
+    void
+    SurfaceVisualization<dim>::set_next_output_time (const double current_time)
+    {
+      // if output_interval is positive, then set the next output interval to
+      // a positive multiple.
+      if (output_interval > 0)
+        {
+          // the current time is always in seconds, so we need to convert the output_interval to the same unit
+          const double output_interval_in_s = (this->convert_output_to_years() ?
+                                               (output_interval*year_in_seconds) :
+                                               output_interval);
+
+          // we need to compute the smallest integer that is bigger than current_time/my_output_interval,
+          // even if it is a whole number already (otherwise we output twice in a row)
+          next_output_time = (std::floor(current_time/output_interval_in_s)+1.0) * output_interval_in_s;
+        }
+    }
+  }
+}
+
+
+// explicit instantiations
+namespace aspect
+{
+  namespace Postprocess
+  {
+    ASPECT_REGISTER_POSTPROCESSOR(SurfaceVisualization,
+                                  "surface visualization",
+                                  "A postprocessor that writes graphical output of the solution "
+                                  "on a part of the boundary of the domain, by default the free "
+                                  "surface if the model has one. The files contain the primary "
+                                  "solution variables, the velocity of the mesh if a free surface "
+                                  "is used, and the additional output variables selected in this "
+                                  "postprocessor's section of the input file. Since only the "
+                                  "faces of the mesh on the selected boundary are written, these "
+                                  "files are much smaller than the ones written by the "
+                                  "'visualization' postprocessor and can be generated much more "
+                                  "frequently. Additional run time parameters are read from the "
+                                  "parameter subsection 'Surface visualization'.")
+  }
+}
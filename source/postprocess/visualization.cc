@@ -24,6 +24,7 @@
 #include <aspect/simulator_access.h>
 #include <aspect/global.h>
 
+#include <deal.II/base/timer.h>
 #include <deal.II/dofs/dof_tools.h>
 #include <deal.II/numerics/data_out.h>
 
@@ -73,6 +74,71 @@ namespace aspect
     }
 
 
+    namespace internal
+    {
+      /**
+       * A class that stores the patches and the names of the output
+       * variables that a DataOut object has computed, independently of the
+       * DoFHandler and the vectors the patches were computed from. Objects
+       * of this type can therefore be handed over to a background thread
+       * that encodes them into one of the graphical output formats while
+       * the main thread continues with the computation and modifies the
+       * mesh and solution vectors.
+       */
+      template <int dim>
+      class PatchSnapshot : public DataOutInterface<dim,dim>
+      {
+        public:
+          std::vector<DataOutBase::Patch<dim,dim> > patches;
+          std::vector<std::string>                   dataset_names;
+          std::vector<std_cxx1x::tuple<unsigned int, unsigned int, std::string> > vector_data_ranges;
+
+        protected:
+          virtual
+          const std::vector<DataOutBase::Patch<dim,dim> > &
+          get_patches () const
+          {
+            return patches;
+          }
+
+          virtual
+          std::vector<std::string>
+          get_dataset_names () const
+          {
+            return dataset_names;
+          }
+
+          virtual
+          std::vector<std_cxx1x::tuple<unsigned int, unsigned int, std::string> >
+          get_vector_data_ranges () const
+          {
+            return vector_data_ranges;
+          }
+      };
+
+
+      /**
+       * A DataOut class that can move the patches it has built into a
+       * PatchSnapshot object. This only swaps internal data and so does not
+       * copy the patches.
+       */
+      template <int dim>
+      class SnapshotDataOut : public DataOut<dim>
+      {
+        public:
+          PatchSnapshot<dim> *
+          create_snapshot ()
+          {
+            PatchSnapshot<dim> *snapshot = new PatchSnapshot<dim>();
+            snapshot->dataset_names      = this->get_dataset_names();
+            snapshot->vector_data_ranges = this->get_vector_data_ranges();
+            snapshot->patches.swap (this->patches);
+            return snapshot;
+          }
+      };
+    }
+
+
     template <int dim>
     Visualization<dim>::Visualization ()
       :
@@ -81,7 +147,10 @@ namespace aspect
       // initialize this to a nonsensical value; set it to the actual time
       // the first time around we get to check it
       next_output_time (std::numeric_limits<double>::quiet_NaN()),
-      output_file_number (0)
+      output_file_number (0),
+      total_bytes_written (0),
+      total_write_time (0),
+      max_pending_writes (1)
     {}
 
 
@@ -89,9 +158,80 @@ namespace aspect
     template <int dim>
     Visualization<dim>::~Visualization ()
     {
-      // make sure a thread that may still be running in the background,
-      // writing data, finishes
-      background_thread.join ();
+      // make sure threads that may still be running in the background,
+      // encoding and writing data, finish
+      wait_for_background_threads (0);
+    }
+
+
+
+    template <int dim>
+    void
+    Visualization<dim>::wait_for_background_threads (const unsigned int n_remaining)
+    {
+      // the threads were started in order, so wait for the oldest ones first
+      while (background_threads.size() > n_remaining)
+        {
+          background_threads.front().join ();
+          background_threads.pop_front ();
+        }
+    }
+
+
+
+    template <int dim>
+    void
+    Visualization<dim>::record_write_statistics (const double bytes_written,
+                                                 const double write_time)
+    {
+      Threads::Mutex::ScopedLock lock (write_statistics_mutex);
+      total_bytes_written += bytes_written;
+      total_write_time    += write_time;
+    }
+
+
+
+    namespace
+    {
+      /**
+       * Return the size of the file with the given name in bytes, or zero if
+       * the file can not be opened.
+       */
+      double
+      file_size (const std::string &filename)
+      {
+        std::ifstream in (filename.c_str(), std::ios::binary | std::ios::ate);
+        if (!in)
+          return 0;
+        return static_cast<double>(in.tellg());
+      }
+
+
+      /**
+       * Translate the compression level given in the input file into the
+       * flags deal.II understands.
+       */
+      void
+      set_compression_level (const std::string     &compression_level,
+                             DataOutBase::VtkFlags &vtk_flags)
+      {
+#if (DEAL_II_VERSION_MAJOR*100 + DEAL_II_VERSION_MINOR) >= 802
+        if (compression_level == "none")
+          vtk_flags.compression_level = DataOutBase::VtkFlags::no_compression;
+        else if (compression_level == "fastest")
+          vtk_flags.compression_level = DataOutBase::VtkFlags::best_speed;
+        else if (compression_level == "default")
+          vtk_flags.compression_level = DataOutBase::VtkFlags::default_compression;
+        else if (compression_level == "best")
+          vtk_flags.compression_level = DataOutBase::VtkFlags::best_compression;
+        else
+          AssertThrow (false, ExcNotImplemented());
+#else
+        // older deal.II versions always use the best compression level
+        (void)compression_level;
+        (void)vtk_flags;
+#endif
+      }
     }
 
 
@@ -121,11 +261,11 @@ namespace aspect
         return std::pair<std::string,std::string>();
 
 
-      // create a DataOut object on the heap; ownership of this
-      // object will later be transferred to a different thread
-      // that will write data in the background. the other thread
-      // will then also destroy the object
-      DataOut<dim> data_out;
+      // create a DataOut object. the patches it builds will later be
+      // moved into a separate object whose ownership is transferred to
+      // a different thread that encodes and writes the data in the
+      // background. the other thread will then also destroy that object
+      internal::SnapshotDataOut<dim> data_out;
       data_out.attach_dof_handler (this->get_dof_handler());
 
       // add the primary variables
@@ -241,12 +381,14 @@ namespace aspect
         }
 
       // now build the patches and see how we can output these
-      data_out.build_patches ();
+      data_out.build_patches (n_subdivisions);
 
       std::string solution_file_prefix = "solution-" + Utilities::int_to_string (output_file_number, 5);
       std::string mesh_file_prefix = "mesh-" + Utilities::int_to_string (output_file_number, 5);
       if (output_format=="hdf5")
         {
+          Timer write_timer;
+
           XDMFEntry new_xdmf_entry;
           std::string     h5_solution_file_name = solution_file_prefix + ".h5";
           std::string     xdmf_filename = this->get_output_directory() + "solution.xdmf";
@@ -279,73 +421,86 @@ namespace aspect
           xdmf_entries.push_back(new_xdmf_entry);
           data_out.write_xdmf_file(xdmf_entries, xdmf_filename.c_str(),
                                    this->get_mpi_communicator());
+
+          // all processors write into the same file, so only let one of
+          // them account for its size
+          if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
+            record_write_statistics (file_size (this->get_output_directory()+h5_solution_file_name)
+                                     +
+                                     (mesh_changed
+                                      ?
+                                      file_size (this->get_output_directory()+last_mesh_file_name)
+                                      :
+                                      0.),
+                                     write_timer.wall_time());
+          else
+            record_write_statistics (0, write_timer.wall_time());
           mesh_changed = false;
         }
       else if ((output_format=="vtu") && (group_files!=0))
         {
-          //TODO: There is some code duplication between the following two
-          //code blocks. unify!
-          AssertThrow(group_files==1, ExcNotImplemented());
-          data_out.write_vtu_in_parallel((this->get_output_directory() + solution_file_prefix +
-                                          ".vtu").c_str(),
-                                         this->get_mpi_communicator());
-
-          if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
-            {
-              std::vector<std::string> filenames;
-              filenames.push_back (solution_file_prefix + ".vtu");
-              const std::string pvtu_master_filename = (solution_file_prefix + ".pvtu");
-              std::ofstream pvtu_master ((this->get_output_directory() +
-                                          pvtu_master_filename).c_str());
-              data_out.write_pvtu_record (pvtu_master, filenames);
-
-              // now also generate a .pvd file that matches simulation
-              // time and corresponding .pvtu record
-              times_and_pvtu_names.push_back(std::make_pair(this->get_time(),
-                                                            pvtu_master_filename));
-              const std::string
-              pvd_master_filename = (this->get_output_directory() + "solution.pvd");
-              std::ofstream pvd_master (pvd_master_filename.c_str());
-              data_out.write_pvd_record (pvd_master, times_and_pvtu_names);
-
-              // finally, do the same for Visit via the .visit file for this
-              // time step, as well as for all time steps together
-              const std::string
-              visit_master_filename = (this->get_output_directory() +
-                                       solution_file_prefix +
-                                       ".visit");
-              std::ofstream visit_master (visit_master_filename.c_str());
-              data_out.write_visit_record (visit_master, filenames);
-
-              output_file_names_by_timestep.push_back (filenames);
-#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) > 800
-              std::ofstream global_visit_master ((this->get_output_directory() +
-                                                  "solution.visit").c_str());
-              data_out.write_visit_record (global_visit_master, output_file_names_by_timestep);
+          // split the processors into (at most) group_files groups of
+          // consecutive ranks. each group then writes one file using
+          // MPI I/O on a communicator that only contains the
+          // processors of this group
+          const unsigned int n_processes = Utilities::MPI::n_mpi_processes(this->get_mpi_communicator());
+          const unsigned int my_id = Utilities::MPI::this_mpi_process(this->get_mpi_communicator());
+          const unsigned int n_files = std::min (group_files, n_processes);
+          const unsigned int my_file_id = my_id * n_files / n_processes;
+
+          // if we only write one file, keep the name without the file
+          // number that was always used in this case
+          std::vector<std::string> filenames;
+          if (n_files == 1)
+            filenames.push_back (solution_file_prefix + ".vtu");
+          else
+            for (unsigned int i=0; i<n_files; ++i)
+              filenames.push_back (solution_file_prefix +
+                                   "." +
+                                   Utilities::int_to_string(i, 4) +
+                                   ".vtu");
+
+          DataOutBase::VtkFlags vtk_flags;
+#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) >= 704
+          vtk_flags.cycle = this->get_timestep_number();
+          vtk_flags.time = this->get_time();
 #endif
-            }
+          set_compression_level (compression_level, vtk_flags);
+          data_out.set_flags (vtk_flags);
+
+          Timer write_timer;
+
+          MPI_Comm group_communicator;
+          const int ierr = MPI_Comm_split (this->get_mpi_communicator(),
+                                           my_file_id,
+                                           my_id,
+                                           &group_communicator);
+          AssertThrow (ierr == MPI_SUCCESS,
+                       ExcMessage ("Could not create the communicator for grouped "
+                                   "graphical output."));
+
+          data_out.write_vtu_in_parallel((this->get_output_directory() +
+                                          filenames[my_file_id]).c_str(),
+                                         group_communicator);
+
+          // let the first processor of each group account for the size of
+          // the file its group has written
+          if (Utilities::MPI::this_mpi_process(group_communicator) == 0)
+            record_write_statistics (file_size (this->get_output_directory() +
+                                                filenames[my_file_id]),
+                                     write_timer.wall_time());
+          else
+            record_write_statistics (0, write_timer.wall_time());
+
+          MPI_Comm_free (&group_communicator);
+
+          // let the master processor write the master record for all the
+          // files
+          if (my_id == 0)
+            write_master_files (data_out, solution_file_prefix, filenames);
         }
       else
         {
-          // put the stuff we want to write into a string object that
-          // we can then write in the background
-          const std::string *file_contents;
-          {
-            std::ostringstream tmp;
-
-            // if deal.II supports it (after 7.3.x), pass time step number and time as
-            // metadata into the output file
-            DataOutBase::VtkFlags vtk_flags;
-#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) >= 704
-            vtk_flags.cycle = this->get_timestep_number();
-            vtk_flags.time = this->get_time();
-#endif
-            data_out.set_flags (vtk_flags);
-
-            data_out.write (tmp, DataOutBase::parse_output_format(output_format));
-            file_contents = new std::string (tmp.str());
-          }
-
           // let the master processor write the master record for all the distributed
           // files
           if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
@@ -357,37 +512,7 @@ namespace aspect
                                      Utilities::int_to_string(i, 4) +
                                      DataOutBase::default_suffix
                                      (DataOutBase::parse_output_format(output_format)));
-              const std::string
-              pvtu_master_filename = (solution_file_prefix +
-                                      ".pvtu");
-              std::ofstream pvtu_master ((this->get_output_directory() +
-                                          pvtu_master_filename).c_str());
-              data_out.write_pvtu_record (pvtu_master, filenames);
-
-              // now also generate a .pvd file that matches simulation
-              // time and corresponding .pvtu record
-              times_and_pvtu_names.push_back(std::pair<double,std::string>
-                                             (this->get_time(), pvtu_master_filename));
-              const std::string
-              pvd_master_filename = (this->get_output_directory() + "solution.pvd");
-              std::ofstream pvd_master (pvd_master_filename.c_str());
-              data_out.write_pvd_record (pvd_master, times_and_pvtu_names);
-
-              // finally, do the same for Visit via the .visit file for this
-              // time step, as well as for all time steps together
-              const std::string
-              visit_master_filename = (this->get_output_directory() +
-                                       solution_file_prefix +
-                                       ".visit");
-              std::ofstream visit_master (visit_master_filename.c_str());
-              data_out.write_visit_record (visit_master, filenames);
-
-              output_file_names_by_timestep.push_back (filenames);
-#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) > 800
-              std::ofstream global_visit_master ((this->get_output_directory() +
-                                                  "solution.visit").c_str());
-              data_out.write_visit_record (global_visit_master, output_file_names_by_timestep);
-#endif
+              write_master_files (data_out, solution_file_prefix, filenames);
             }
 
           const std::string *filename
@@ -399,20 +524,63 @@ namespace aspect
                                DataOutBase::default_suffix
                                (DataOutBase::parse_output_format(output_format)));
 
-          // wait for all previous write operations to finish, should
-          // any be still active
-          background_thread.join ();
+          // move the patches we have built into an object that no longer
+          // references the mesh and solution vectors. encoding these patches
+          // into the output format and writing the result to disk can then
+          // happen in the background while we continue with the next time
+          // step
+          internal::PatchSnapshot<dim> *patches = data_out.create_snapshot ();
+
+          // if deal.II supports it (after 7.3.x), pass time step number and time as
+          // metadata into the output file
+          DataOutBase::VtkFlags vtk_flags;
+#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) >= 704
+          vtk_flags.cycle = this->get_timestep_number();
+          vtk_flags.time = this->get_time();
+#endif
+          set_compression_level (compression_level, vtk_flags);
+          patches->set_flags (vtk_flags);
+
+          // wait for previous write operations to finish until there is
+          // room for another one, should too many be still active
+          wait_for_background_threads (max_pending_writes-1);
 
           // then continue with writing our own stuff
-          background_thread = Threads::new_thread (&background_writer,
-                                                   filename,
-                                                   file_contents);
+          background_threads.push_back (Threads::new_thread (&Visualization<dim>::background_encoder,
+                                                             *this,
+                                                             filename,
+                                                             patches,
+                                                             DataOutBase::parse_output_format(output_format)));
         }
 
       // record the file base file name in the output file
       statistics.add_value ("Visualization file name",
                             this->get_output_directory() + solution_file_prefix);
 
+      // if so requested, also record how much data we have written so far
+      // and how long it took. output that is still being written in the
+      // background will only be accounted for the next time we get here
+      if (record_output_statistics)
+        {
+          double local_bytes_written, local_write_time;
+          {
+            Threads::Mutex::ScopedLock lock (write_statistics_mutex);
+            local_bytes_written = total_bytes_written;
+            local_write_time    = total_write_time;
+          }
+
+          statistics.add_value ("Visualization output size (MB)",
+                                Utilities::MPI::sum (local_bytes_written,
+                                                     this->get_mpi_communicator()) / 1024. / 1024.);
+          statistics.add_value ("Visualization output time (s)",
+                                Utilities::MPI::max (local_write_time,
+                                                     this->get_mpi_communicator()));
+          statistics.set_precision ("Visualization output size (MB)", 3);
+          statistics.set_scientific ("Visualization output size (MB)", false);
+          statistics.set_precision ("Visualization output time (s)", 3);
+          statistics.set_scientific ("Visualization output time (s)", false);
+        }
+
       // up the counter of the number of the file by one; also
       // up the next time we need output
       ++output_file_number;
@@ -424,6 +592,70 @@ namespace aspect
     }
 
 
+    template <int dim>
+    void
+    Visualization<dim>::write_master_files (const DataOutInterface<dim,dim> &data_out,
+                                            const std::string               &solution_file_prefix,
+                                            const std::vector<std::string>  &filenames)
+    {
+      const std::string
+      pvtu_master_filename = (solution_file_prefix +
+                              ".pvtu");
+      std::ofstream pvtu_master ((this->get_output_directory() +
+                                  pvtu_master_filename).c_str());
+      data_out.write_pvtu_record (pvtu_master, filenames);
+
+      // now also generate a .pvd file that matches simulation
+      // time and corresponding .pvtu record
+      times_and_pvtu_names.push_back(std::pair<double,std::string>
+                                     (this->get_time(), pvtu_master_filename));
+      const std::string
+      pvd_master_filename = (this->get_output_directory() + "solution.pvd");
+      std::ofstream pvd_master (pvd_master_filename.c_str());
+      data_out.write_pvd_record (pvd_master, times_and_pvtu_names);
+
+      // finally, do the same for Visit via the .visit file for this
+      // time step, as well as for all time steps together
+      const std::string
+      visit_master_filename = (this->get_output_directory() +
+                               solution_file_prefix +
+                               ".visit");
+      std::ofstream visit_master (visit_master_filename.c_str());
+      data_out.write_visit_record (visit_master, filenames);
+
+      output_file_names_by_timestep.push_back (filenames);
+#if (DEAL_II_MAJOR*100 + DEAL_II_MINOR) > 800
+      std::ofstream global_visit_master ((this->get_output_directory() +
+                                          "solution.visit").c_str());
+      data_out.write_visit_record (global_visit_master, output_file_names_by_timestep);
+#endif
+    }
+
+
+    template <int dim>
+    void Visualization<dim>::background_encoder (const std::string               *filename,
+                                                 const DataOutInterface<dim,dim> *patches,
+                                                 const DataOutBase::OutputFormat  output_format)
+    {
+      Timer write_timer;
+
+      // put the stuff we want to write into a string object
+      std::ostringstream tmp;
+      patches->write (tmp, output_format);
+      const std::string *file_contents = new std::string (tmp.str());
+      const double bytes_written = file_contents->size();
+
+      // we no longer need the patches, so free the memory before
+      // writing
+      delete patches;
+
+      // then write the data. this also deletes the remaining pointers
+      background_writer (filename, file_contents);
+
+      record_write_statistics (bytes_written, write_timer.wall_time());
+    }
+
+
     template <int dim>
     void Visualization<dim>::background_writer (const std::string *filename,
                                                 const std::string *file_contents)
@@ -574,7 +806,57 @@ namespace aspect
                              "parallel file output and instead write one file per processor "
                              "in a background thread. "
                              "A value of 1 will generate one big file containing the whole "
-                             "solution.");
+                             "solution. A larger value $G$ splits the processors into $G$ "
+                             "groups of consecutive ranks, each of which writes one file "
+                             "using MPI I/O, which avoids both creating very many small files "
+                             "and having all processors write into the same file. If $G$ is "
+                             "larger than the number of processors, one file per processor "
+                             "is written.");
+
+          prm.declare_entry ("Number of subdivisions", "1",
+                             Patterns::Integer(1),
+                             "The number of times each cell is subdivided in each "
+                             "coordinate direction when writing graphical output. "
+                             "A value of one writes the (bi-/tri-)linear interpolation "
+                             "of the solution on every cell; larger values show more "
+                             "detail of higher order finite element fields but "
+                             "increase the size of output files by a factor of "
+                             "this value to the power of the dimension.");
+
+          prm.declare_entry ("Compression level", "best",
+                             Patterns::Selection("none|fastest|default|best"),
+                             "The zlib compression level used for the data in VTU "
+                             "files. 'best' yields the smallest files but takes the "
+                             "longest to generate, 'none' generates the largest files "
+                             "the fastest. This parameter is only honored if ASPECT "
+                             "is compiled against deal.II 8.2 or newer and deal.II "
+                             "was configured with zlib; older versions always use "
+                             "the best compression level.");
+
+          prm.declare_entry ("Record output size and time", "false",
+                             Patterns::Bool(),
+                             "Whether to add the total size of all graphical output "
+                             "files written so far (summed over all processors) and "
+                             "the total wall time spent converting the data into the "
+                             "output format and writing it to disk (maximum over all "
+                             "processors) to the statistics file whenever graphical "
+                             "output is generated. Output that is still being written "
+                             "in the background is only accounted for the next time "
+                             "graphical output is generated.");
+
+          prm.declare_entry ("Maximum number of pending output writes", "1",
+                             Patterns::Integer(1),
+                             "When writing one file per processor (i.e., if 'Number of "
+                             "grouped files' is zero and the output format is not hdf5), "
+                             "the graphical output is converted into the selected file "
+                             "format and written to disk on a background thread while "
+                             "the computation continues. This parameter determines how "
+                             "many of these background operations may be pending at any "
+                             "given time. If this number is reached when graphical output "
+                             "is to be generated again, the program waits for the oldest "
+                             "of them to finish. Larger values allow to hide slow file "
+                             "systems for frequent output, at the cost of having to keep "
+                             "the data of several outputs in memory at the same time.");
 
           // finally also construct a string for Patterns::MultipleSelection that
           // contains the names of all registered visualization postprocessors
@@ -623,12 +905,19 @@ namespace aspect
           output_interval = prm.get_double ("Time between graphical output");
           output_format   = prm.get ("Output format");
           group_files     = prm.get_integer("Number of grouped files");
+          max_pending_writes = prm.get_integer("Maximum number of pending output writes");
+          n_subdivisions  = prm.get_integer("Number of subdivisions");
+          compression_level = prm.get ("Compression level");
+          record_output_statistics = prm.get_bool ("Record output size and time");
 
           // now also see which derived quantities we are to compute
           viz_names = Utilities::split_string_list(prm.get("List of output variables"));
 
           // see if 'all' was selected (or is part of the list). if so
-          // simply replace the list with one that contains all names
+          // simply replace the list with one that contains all names.
+          // skip the 'material properties' postprocessor since it only
+          // combines what the individual material property postprocessors
+          // already output and would lead to duplicate output variables
           if (std::find (viz_names.begin(),
                          viz_names.end(),
                          "all") != viz_names.end())
@@ -637,7 +926,8 @@ namespace aspect
               for (typename std::list<typename aspect::internal::Plugins::PluginList<VisualizationPostprocessors::Interface<dim> >::PluginInfo>::const_iterator
                    p = std_cxx1x::get<dim>(registered_plugins).plugins->begin();
                    p != std_cxx1x::get<dim>(registered_plugins).plugins->end(); ++p)
-                viz_names.push_back (std_cxx1x::get<0>(*p));
+                if (std_cxx1x::get<0>(*p) != "material properties")
+                  viz_names.push_back (std_cxx1x::get<0>(*p));
             }
         }
         prm.leave_subsection();
@@ -767,6 +1057,25 @@ namespace aspect
     }
 
 
+    template <int dim>
+    std::string
+    Visualization<dim>::get_names_of_visualization_postprocessors ()
+    {
+      return std_cxx1x::get<dim>(registered_plugins).get_pattern_of_names ();
+    }
+
+
+    template <int dim>
+    VisualizationPostprocessors::Interface<dim> *
+    Visualization<dim>::create_visualization_postprocessor (const std::string &name,
+                                                            ParameterHandler  &prm)
+    {
+      return std_cxx1x::get<dim>(registered_plugins).create_plugin (name,
+                                                                    "Visualization plugins",
+                                                                    prm);
+    }
+
+
     template <int dim>
     void
     Visualization<dim>::
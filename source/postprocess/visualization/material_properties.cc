@@ -0,0 +1,248 @@
+/*
+  Copyright (C) 2014 by the authors of the ASPECT code.
+
+  This file is part of ASPECT.
+
+  ASPECT is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2, or (at your option)
+  any later version.
+
+  ASPECT is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with ASPECT; see the file doc/COPYING.  If not see
+  <http://www.gnu.org/licenses/>.
+*/
+/*  $Id$  */
+
+
+#include <aspect/postprocess/visualization/material_properties.h>
+#include <aspect/simulator_access.h>
+
+#include <deal.II/numerics/data_out.h>
+#include <deal.II/base/parameter_handler.h>
+
+#include <algorithm>
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    namespace VisualizationPostprocessors
+    {
+      template <int dim>
+      std::vector<std::string>
+      MaterialProperties<dim>::get_names () const
+      {
+        // the names in the output file are the same as the ones in the
+        // input file, but with spaces replaced by underscores, in the
+        // same way the individual visualization postprocessors name
+        // their output
+        std::vector<std::string> names;
+        for (unsigned int i=0; i<property_names.size(); ++i)
+          {
+            std::string name = property_names[i];
+            std::replace (name.begin(), name.end(), ' ', '_');
+            names.push_back (name);
+          }
+        return names;
+      }
+
+
+
+      template <int dim>
+      std::vector<DataComponentInterpretation::DataComponentInterpretation>
+      MaterialProperties<dim>::get_data_component_interpretation () const
+      {
+        return std::vector<DataComponentInterpretation::DataComponentInterpretation>
+               (property_names.size(),
+                DataComponentInterpretation::component_is_scalar);
+      }
+
+
+
+      template <int dim>
+      UpdateFlags
+      MaterialProperties<dim>::get_needed_update_flags () const
+      {
+        if (needs_viscosity())
+          return update_values | update_gradients | update_q_points;
+        else
+          return update_values | update_q_points;
+      }
+
+
+
+      template <int dim>
+      bool
+      MaterialProperties<dim>::needs_viscosity () const
+      {
+        return (std::find (property_names.begin(),
+                           property_names.end(),
+                           "viscosity") != property_names.end());
+      }
+
+
+
+      template <int dim>
+      void
+      MaterialProperties<dim>::
+      compute_derived_quantities_vector (const std::vector<Vector<double> >              &uh,
+                                         const std::vector<std::vector<Tensor<1,dim> > > &duh,
+                                         const std::vector<std::vector<Tensor<2,dim> > > &,
+                                         const std::vector<Point<dim> > &,
+                                         const std::vector<Point<dim> >                  &evaluation_points,
+                                         std::vector<Vector<double> >                    &computed_quantities) const
+      {
+        const unsigned int n_quadrature_points = uh.size();
+        Assert (computed_quantities.size() == n_quadrature_points,    ExcInternalError());
+        Assert (computed_quantities[0].size() == property_names.size(), ExcInternalError());
+        Assert (uh[0].size() == dim+2+this->n_compositional_fields(), ExcInternalError());
+
+        typename MaterialModel::Interface<dim>::MaterialModelInputs in(n_quadrature_points,
+                                                                       this->n_compositional_fields());
+        typename MaterialModel::Interface<dim>::MaterialModelOutputs out(n_quadrature_points,
+                                                                         this->n_compositional_fields());
+
+        // only ask the material model to compute the viscosity (and
+        // consequently only compute the strain rate) if we actually need
+        // to output it
+        const bool compute_viscosity = needs_viscosity();
+        if (compute_viscosity == false)
+          in.strain_rate.resize(0);
+
+        in.position = evaluation_points;
+        for (unsigned int q=0; q<n_quadrature_points; ++q)
+          {
+            if (compute_viscosity)
+              {
+                Assert (duh[q].size() == dim+2+this->n_compositional_fields(), ExcInternalError());
+
+                Tensor<2,dim> grad_u;
+                for (unsigned int d=0; d<dim; ++d)
+                  grad_u[d] = duh[q][d];
+                in.strain_rate[q] = symmetrize (grad_u);
+              }
+
+            in.pressure[q]=uh[q][dim];
+            in.temperature[q]=uh[q][dim+1];
+
+            for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
+              in.composition[q][c] = uh[q][dim+2+c];
+          }
+
+        // evaluate the material model once for all of the properties we
+        // want to output
+        this->get_material_model().evaluate(in, out);
+
+        for (unsigned int i=0; i<property_names.size(); ++i)
+          {
+            const std::vector<double> *values = 0;
+            if (property_names[i] == "viscosity")
+              values = &out.viscosities;
+            else if (property_names[i] == "density")
+              values = &out.densities;
+            else if (property_names[i] == "thermal expansivity")
+              values = &out.thermal_expansion_coefficients;
+            else if (property_names[i] == "specific heat")
+              values = &out.specific_heat;
+            else if (property_names[i] == "thermal conductivity")
+              values = &out.thermal_conductivities;
+            else if (property_names[i] == "compressibility")
+              values = &out.compressibilities;
+            else
+              AssertThrow (false, ExcNotImplemented());
+
+            for (unsigned int q=0; q<n_quadrature_points; ++q)
+              computed_quantities[q](i) = (*values)[q];
+          }
+      }
+
+
+
+      template <int dim>
+      void
+      MaterialProperties<dim>::declare_parameters (ParameterHandler &prm)
+      {
+        prm.enter_subsection("Postprocess");
+        {
+          prm.enter_subsection("Visualization");
+          {
+            prm.enter_subsection("Material properties");
+            {
+              prm.declare_entry ("List of material properties", "density,viscosity",
+                                 Patterns::MultipleSelection("viscosity|density|"
+                                                             "thermal expansivity|"
+                                                             "specific heat|"
+                                                             "thermal conductivity|"
+                                                             "compressibility"),
+                                 "A comma separated list of material properties that "
+                                 "should be written whenever writing graphical output. "
+                                 "All of these properties are computed from a single "
+                                 "evaluation of the material model at each output point.");
+            }
+            prm.leave_subsection();
+          }
+          prm.leave_subsection();
+        }
+        prm.leave_subsection();
+      }
+
+
+
+      template <int dim>
+      void
+      MaterialProperties<dim>::parse_parameters (ParameterHandler &prm)
+      {
+        prm.enter_subsection("Postprocess");
+        {
+          prm.enter_subsection("Visualization");
+          {
+            prm.enter_subsection("Material properties");
+            {
+              property_names = Utilities::split_string_list(prm.get ("List of material properties"));
+              AssertThrow (property_names.size() > 0,
+                           ExcMessage ("The 'material properties' visualization postprocessor "
+                                       "requires at least one entry in its "
+                                       "'List of material properties' parameter."));
+            }
+            prm.leave_subsection();
+          }
+          prm.leave_subsection();
+        }
+        prm.leave_subsection();
+      }
+    }
+  }
+}
+
+
+// explicit instantiations
+namespace aspect
+{
+  namespace Postprocess
+  {
+    namespace VisualizationPostprocessors
+    {
+      ASPECT_REGISTER_VISUALIZATION_POSTPROCESSOR(MaterialProperties,
+                                                  "material properties",
+                                                  "A visualization output object that generates output "
+                                                  "for a selection of material properties (viscosity, "
+                                                  "density, thermal expansivity, specific heat, thermal "
+                                                  "conductivity, and compressibility) from a single "
+                                                  "evaluation of the material model per output point. "
+                                                  "This is considerably cheaper than selecting the "
+                                                  "corresponding individual visualization postprocessors "
+                                                  "because each of these evaluates the material model "
+                                                  "separately. Since the output variables have the same "
+                                                  "names as the individual postprocessors, this object "
+                                                  "should not be selected together with those for the "
+                                                  "same property.")
+    }
+  }
+}
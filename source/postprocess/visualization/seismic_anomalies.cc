@@ -24,6 +24,7 @@
 #include <aspect/simulator_access.h>
 
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/work_stream.h>
 #include <deal.II/fe/fe_values.h>
 
 namespace aspect
@@ -59,18 +60,212 @@ namespace aspect
 
 
         /**
-         * Copy the values of the compositional fields at the quadrature point
-         * q given as input parameter to the output vector
-         * composition_values_at_q_point.
+         * The number of depth slices over which we compute the laterally
+         * averaged seismic velocities. This matches the default number of
+         * zones of the DepthAverage postprocessor, so that the averages
+         * computed during a postprocessing step can be shared with it.
          */
-        void
-        extract_composition_values_at_q_point (const std::vector<std::vector<double> > &composition_values,
-                                               const unsigned int                      q,
-                                               std::vector<double>                    &composition_values_at_q_point)
+        const unsigned int n_depth_slices = 100;
+
+        /**
+         * Half-width of the window of the running average with which we
+         * smooth the laterally averaged seismic velocities.
+         */
+        const int n_running_average_points = 2;
+
+
+
+        /**
+         * Scratch space for the computation of the seismic anomaly on one
+         * cell.
+         */
+        template <int dim>
+        struct SeismicAnomalyScratch
         {
-          for (unsigned int k=0; k < composition_values_at_q_point.size(); ++k)
-            composition_values_at_q_point[k] = composition_values[k][q];
-        }
+          SeismicAnomalyScratch (const Mapping<dim>       &mapping,
+                                 const FiniteElement<dim> &finite_element,
+                                 const unsigned int        n_compositional_fields);
+          SeismicAnomalyScratch (const SeismicAnomalyScratch &scratch);
+
+          FEValues<dim>                     fe_values;
+
+          std::vector<double>               pressure_values;
+          std::vector<double>               temperature_values;
+          std::vector<std::vector<double> > composition_values;
+          std::vector<double>               composition_values_at_q_point;
+        };
+
+
+
+        template <int dim>
+        SeismicAnomalyScratch<dim>::
+        SeismicAnomalyScratch (const Mapping<dim>       &mapping,
+                               const FiniteElement<dim> &finite_element,
+                               const unsigned int        n_compositional_fields)
+          :
+          // evaluate a single point per cell
+          fe_values (mapping, finite_element, QMidpoint<dim>(),
+                     update_values | update_quadrature_points),
+          pressure_values (1),
+          temperature_values (1),
+          composition_values (n_compositional_fields, std::vector<double>(1)),
+          composition_values_at_q_point (n_compositional_fields)
+        {}
+
+
+
+        template <int dim>
+        SeismicAnomalyScratch<dim>::
+        SeismicAnomalyScratch (const SeismicAnomalyScratch &scratch)
+          :
+          fe_values (scratch.fe_values.get_mapping(),
+                     scratch.fe_values.get_fe(),
+                     scratch.fe_values.get_quadrature(),
+                     scratch.fe_values.get_update_flags()),
+          pressure_values (scratch.pressure_values),
+          temperature_values (scratch.temperature_values),
+          composition_values (scratch.composition_values),
+          composition_values_at_q_point (scratch.composition_values_at_q_point)
+        {}
+
+
+
+        /**
+         * The result of the computation on one cell: the index of the cell
+         * among all active cells, and the anomaly on this cell.
+         */
+        struct SeismicAnomalyCopyData
+        {
+          unsigned int cell_index;
+          float        anomaly;
+        };
+
+
+
+        /**
+         * A class that computes the anomaly of either the shear or the
+         * compression wave speed on all locally owned cells. The cells are
+         * processed in parallel using WorkStream.
+         */
+        template <int dim>
+        class SeismicAnomalyComputer
+        {
+          public:
+            typedef
+            std::vector<std::pair<typename DoFHandler<dim>::active_cell_iterator, unsigned int> >
+            CellList;
+
+            SeismicAnomalyComputer (const bool                           compute_vs,
+                                    const std::vector<double>           &depth_average,
+                                    const Introspection<dim>            &introspection,
+                                    const LinearAlgebra::BlockVector    &solution,
+                                    const MaterialModel::Interface<dim> &material_model,
+                                    const GeometryModel::Interface<dim> &geometry_model)
+              :
+              compute_vs (compute_vs),
+              depth_average (depth_average),
+              introspection (introspection),
+              solution (solution),
+              material_model (material_model),
+              geometry_model (geometry_model),
+              max_depth (geometry_model.maximal_depth())
+            {}
+
+            /**
+             * Fill the elements of @p anomaly that correspond to locally
+             * owned cells.
+             */
+            void
+            compute (const Mapping<dim>     &mapping,
+                     const DoFHandler<dim>  &dof_handler,
+                     const unsigned int      n_compositional_fields,
+                     Vector<float>          &anomaly) const
+            {
+              // collect the locally owned cells along with their index among
+              // all active cells, which is where their value goes in the
+              // output vector
+              CellList cells;
+              unsigned int cell_index = 0;
+              for (typename DoFHandler<dim>::active_cell_iterator
+                   cell = dof_handler.begin_active();
+                   cell != dof_handler.end(); ++cell, ++cell_index)
+                if (cell->is_locally_owned())
+                  cells.push_back (std::make_pair (cell, cell_index));
+
+              WorkStream::
+              run (cells.begin(),
+                   cells.end(),
+                   std_cxx1x::bind (&SeismicAnomalyComputer<dim>::local_compute,
+                                    this,
+                                    std_cxx1x::_1,
+                                    std_cxx1x::_2,
+                                    std_cxx1x::_3),
+                   std_cxx1x::bind (&SeismicAnomalyComputer<dim>::copy_local_to_global,
+                                    std_cxx1x::_1,
+                                    std_cxx1x::ref(anomaly)),
+                   SeismicAnomalyScratch<dim> (mapping,
+                                               dof_handler.get_fe(),
+                                               n_compositional_fields),
+                   SeismicAnomalyCopyData());
+            }
+
+          private:
+            void
+            local_compute (const typename CellList::iterator &cell,
+                           SeismicAnomalyScratch<dim>        &scratch,
+                           SeismicAnomalyCopyData            &data) const
+            {
+              scratch.fe_values.reinit (cell->first);
+              scratch.fe_values[introspection.extractors.pressure].get_function_values (solution,
+                                                                                        scratch.pressure_values);
+              scratch.fe_values[introspection.extractors.temperature].get_function_values (solution,
+                                                                                           scratch.temperature_values);
+              for (unsigned int c=0; c<scratch.composition_values.size(); ++c)
+                {
+                  scratch.fe_values[introspection.extractors.compositional_fields[c]].get_function_values(solution,
+                      scratch.composition_values[c]);
+                  scratch.composition_values_at_q_point[c] = scratch.composition_values[c][0];
+                }
+
+              const Point<dim> position = scratch.fe_values.quadrature_point(0);
+              const double velocity = (compute_vs
+                                       ?
+                                       material_model.seismic_Vs(scratch.temperature_values[0],
+                                                                 scratch.pressure_values[0],
+                                                                 scratch.composition_values_at_q_point,
+                                                                 position)
+                                       :
+                                       material_model.seismic_Vp(scratch.temperature_values[0],
+                                                                 scratch.pressure_values[0],
+                                                                 scratch.composition_values_at_q_point,
+                                                                 position));
+
+              const unsigned int num_slices = depth_average.size();
+              const double depth = geometry_model.depth(position);
+              const unsigned int idx = std::min (static_cast<unsigned int>((depth*num_slices)/max_depth),
+                                                 num_slices-1);
+
+              // compute the deviation from the average in per cent
+              data.cell_index = cell->second;
+              data.anomaly = (velocity - depth_average[idx])/depth_average[idx]*1e2;
+            }
+
+            static
+            void
+            copy_local_to_global (const SeismicAnomalyCopyData &data,
+                                  Vector<float>                &anomaly)
+            {
+              anomaly(data.cell_index) = data.anomaly;
+            }
+
+            const bool                           compute_vs;
+            const std::vector<double>           &depth_average;
+            const Introspection<dim>            &introspection;
+            const LinearAlgebra::BlockVector    &solution;
+            const MaterialModel::Interface<dim> &material_model;
+            const GeometryModel::Interface<dim> &geometry_model;
+            const double                         max_depth;
+        };
       }
 
 
@@ -83,65 +278,22 @@ namespace aspect
         return_value ("Vs_anomaly",
                       new Vector<float>(this->get_triangulation().n_active_cells()));
 
-
-        const int npoints = 2; // npoint in running average half-width of window
-        std::vector<double> Vs_depth_average;
-
+        // the depth average is computed only once per postprocessing step
+        // and shared with other postprocessors that need it
+        std::vector<double> Vs_depth_average (n_depth_slices);
         this->get_depth_average_Vs(Vs_depth_average);
-        compute_running_average(Vs_depth_average, npoints);
-
-        const unsigned int num_slices = Vs_depth_average.size();
-        const double max_depth = this->get_geometry_model().maximal_depth();
-
-        // evaluate a single point per cell
-        const QMidpoint<dim> quadrature_formula;
-        const unsigned int n_q_points = quadrature_formula.size();
-
-        FEValues<dim> fe_values (this->get_mapping(),
-                                 this->get_fe(),
-                                 quadrature_formula,
-                                 update_values   |
-                                 update_quadrature_points );
-
-        std::vector<double> pressure_values(n_q_points);
-        std::vector<double> temperature_values(n_q_points);
-        std::vector<std::vector<double> > composition_values (this->n_compositional_fields(),
-                                                              std::vector<double> (n_q_points));
-        std::vector<double> composition_values_at_q_point (this->n_compositional_fields());
-
-        typename DoFHandler<dim>::active_cell_iterator
-        cell = this->get_dof_handler().begin_active(),
-        endc = this->get_dof_handler().end();
-
-        unsigned int cell_index = 0;
-        for (; cell!=endc; ++cell,++cell_index)
-          if (cell->is_locally_owned())
-            {
-              fe_values.reinit (cell);
-              fe_values[this->introspection().extractors.pressure].get_function_values (this->get_solution(),
-                                                                                        pressure_values);
-              fe_values[this->introspection().extractors.temperature].get_function_values (this->get_solution(),
-                                                                                           temperature_values);
-              for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-                fe_values[this->introspection().extractors.compositional_fields[c]].get_function_values(this->get_solution(),
-                    composition_values[c]);
-
-
-              extract_composition_values_at_q_point (composition_values,
-                                                     0,
-                                                     composition_values_at_q_point);
-
-              const double Vs = this->get_material_model().seismic_Vs(temperature_values[0],
-                                                                      pressure_values[0],
-                                                                      composition_values_at_q_point,
-                                                                      fe_values.quadrature_point(0));
-              const double depth = this->get_geometry_model().depth(fe_values.quadrature_point(0));
-              const unsigned int idx = static_cast<unsigned int>((depth*num_slices)/max_depth);
-              Assert(idx<num_slices, ExcInternalError());
-
-              // compute the deviation from the average in per cent
-              (*return_value.second)(cell_index) = (Vs - Vs_depth_average[idx])/Vs_depth_average[idx]*1e2;
-            }
+        compute_running_average(Vs_depth_average, n_running_average_points);
+
+        SeismicAnomalyComputer<dim> (true /* Vs */,
+                                     Vs_depth_average,
+                                     this->introspection(),
+                                     this->get_solution(),
+                                     this->get_material_model(),
+                                     this->get_geometry_model())
+        .compute (this->get_mapping(),
+                  this->get_dof_handler(),
+                  this->n_compositional_fields(),
+                  *return_value.second);
 
         return return_value;
       }
@@ -155,65 +307,22 @@ namespace aspect
         return_value ("Vp_anomaly",
                       new Vector<float>(this->get_triangulation().n_active_cells()));
 
-
-        const int npoints = 2; // npoint in running average half-width of window
-        std::vector<double> Vp_depth_average;
-
+        // the depth average is computed only once per postprocessing step
+        // and shared with other postprocessors that need it
+        std::vector<double> Vp_depth_average (n_depth_slices);
         this->get_depth_average_Vp(Vp_depth_average);
-        compute_running_average(Vp_depth_average, npoints);
-
-        const unsigned int num_slices = Vp_depth_average.size();
-        const double max_depth = this->get_geometry_model().maximal_depth();
-
-        // evaluate a single point per cell
-        const QMidpoint<dim> quadrature_formula;
-        const unsigned int n_q_points = quadrature_formula.size();
-
-        FEValues<dim> fe_values (this->get_mapping(),
-                                 this->get_fe(),
-                                 quadrature_formula,
-                                 update_values   |
-                                 update_quadrature_points );
-
-        std::vector<double> pressure_values(n_q_points);
-        std::vector<double> temperature_values(n_q_points);
-        std::vector<std::vector<double> > composition_values (this->n_compositional_fields(),
-                                                              std::vector<double> (n_q_points));
-        std::vector<double> composition_values_at_q_point (this->n_compositional_fields());
-
-        typename DoFHandler<dim>::active_cell_iterator
-        cell = this->get_dof_handler().begin_active(),
-        endc = this->get_dof_handler().end();
-
-        unsigned int cell_index = 0;
-        for (; cell!=endc; ++cell,++cell_index)
-          if (cell->is_locally_owned())
-            {
-              fe_values.reinit (cell);
-              fe_values[this->introspection().extractors.pressure].get_function_values (this->get_solution(),
-                                                                                        pressure_values);
-              fe_values[this->introspection().extractors.temperature].get_function_values (this->get_solution(),
-                                                                                           temperature_values);
-              for (unsigned int c=0; c<this->n_compositional_fields(); ++c)
-                fe_values[this->introspection().extractors.compositional_fields[c]].get_function_values(this->get_solution(),
-                    composition_values[c]);
-
-
-              extract_composition_values_at_q_point (composition_values,
-                                                     0,
-                                                     composition_values_at_q_point);
-
-              const double Vp = this->get_material_model().seismic_Vp(temperature_values[0],
-                                                                      pressure_values[0],
-                                                                      composition_values_at_q_point,
-                                                                      fe_values.quadrature_point(0));
-              const double depth = this->get_geometry_model().depth(fe_values.quadrature_point(0));
-              const unsigned int idx = static_cast<unsigned int>((depth*num_slices)/max_depth);
-              Assert(idx<num_slices, ExcInternalError());
-
-              // compute the deviation from the average in per cent
-              (*return_value.second)(cell_index) = (Vp - Vp_depth_average[idx])/Vp_depth_average[idx]*1e2;
-            }
+        compute_running_average(Vp_depth_average, n_running_average_points);
+
+        SeismicAnomalyComputer<dim> (false /* Vp */,
+                                     Vp_depth_average,
+                                     this->introspection(),
+                                     this->get_solution(),
+                                     this->get_material_model(),
+                                     this->get_geometry_model())
+        .compute (this->get_mapping(),
+                  this->get_dof_handler(),
+                  this->n_compositional_fields(),
+                  *return_value.second);
 
         return return_value;
       }
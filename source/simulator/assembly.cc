@@ -67,6 +67,15 @@ namespace aspect
 
           typename MaterialModel::Interface<dim>::MaterialModelInputs material_model_inputs;
           typename MaterialModel::Interface<dim>::MaterialModelOutputs material_model_outputs;
+
+          /**
+           * The indices of the velocity and pressure shape functions on a
+           * cell, and space for the global indices of all degrees of
+           * freedom of a cell. These are only used when assembling the
+           * preconditioner, which only stores the Stokes blocks.
+           */
+          std::vector<unsigned int>            stokes_dofs;
+          std::vector<types::global_dof_index> cell_dof_indices;
         };
 
 
@@ -89,7 +98,8 @@ namespace aspect
           composition_values(n_compositional_fields,
                              std::vector<double>(quadrature.size())),
           material_model_inputs(quadrature.size(), n_compositional_fields),
-          material_model_outputs(quadrature.size(), n_compositional_fields)
+          material_model_outputs(quadrature.size(), n_compositional_fields),
+          cell_dof_indices (finite_element.dofs_per_cell)
         {}
 
 
@@ -109,7 +119,9 @@ namespace aspect
           strain_rates (scratch.strain_rates),
           composition_values(scratch.composition_values),
           material_model_inputs(scratch.material_model_inputs),
-          material_model_outputs(scratch.material_model_outputs)
+          material_model_outputs(scratch.material_model_outputs),
+          stokes_dofs (scratch.stokes_dofs),
+          cell_dof_indices (scratch.cell_dof_indices)
         {}
 
 
@@ -144,6 +156,13 @@ namespace aspect
 
           typename MaterialModel::Interface<dim>::MaterialModelInputs material_model_inputs;
           typename MaterialModel::Interface<dim>::MaterialModelOutputs material_model_outputs;
+
+          /**
+           * Material model outputs for slightly larger strain rates, used to
+           * compute the derivative of the viscosity with respect to the
+           * strain rate for the Newton linearization.
+           */
+          typename MaterialModel::Interface<dim>::MaterialModelOutputs perturbed_material_model_outputs;
         };
 
 
@@ -166,7 +185,8 @@ namespace aspect
           composition_values(n_compositional_fields,
                              std::vector<double>(quadrature.size())),
           material_model_inputs(quadrature.size(), n_compositional_fields),
-          material_model_outputs(quadrature.size(), n_compositional_fields)
+          material_model_outputs(quadrature.size(), n_compositional_fields),
+          perturbed_material_model_outputs(quadrature.size(), n_compositional_fields)
         {}
 
 
@@ -182,7 +202,8 @@ namespace aspect
           velocity_values (scratch.velocity_values),
           composition_values(scratch.composition_values),
           material_model_inputs(scratch.material_model_inputs),
-          material_model_outputs(scratch.material_model_outputs)
+          material_model_outputs(scratch.material_model_outputs),
+          perturbed_material_model_outputs(scratch.perturbed_material_model_outputs)
         {}
 
         template <int dim>
@@ -364,6 +385,7 @@ namespace aspect
         struct StokesPreconditioner
         {
           StokesPreconditioner (const FiniteElement<dim> &finite_element);
+          StokesPreconditioner (const unsigned int n_local_dofs);
           StokesPreconditioner (const StokesPreconditioner &data);
 
           virtual ~StokesPreconditioner ();
@@ -385,6 +407,17 @@ namespace aspect
 
 
 
+        template <int dim>
+        StokesPreconditioner<dim>::
+        StokesPreconditioner (const unsigned int n_local_dofs)
+          :
+          local_matrix (n_local_dofs,
+                        n_local_dofs),
+          local_dof_indices (n_local_dofs)
+        {}
+
+
+
         template <int dim>
         StokesPreconditioner<dim>::
         StokesPreconditioner (const StokesPreconditioner &data)
@@ -905,6 +938,7 @@ namespace aspect
                                         internal::Assembly::CopyData::StokesPreconditioner<dim> &data)
   {
     const unsigned int   dofs_per_cell   = finite_element.dofs_per_cell;
+    const unsigned int   n_stokes_dofs   = scratch.stokes_dofs.size();
     const unsigned int   n_q_points      = scratch.finite_element_values.n_quadrature_points;
 
     scratch.finite_element_values.reinit (cell);
@@ -928,23 +962,31 @@ namespace aspect
 
         const double eta = scratch.material_model_outputs.viscosities[q];
 
-        for (unsigned int i=0; i<dofs_per_cell; ++i)
-          for (unsigned int j=0; j<dofs_per_cell; ++j)
-            if (finite_element.system_to_component_index(i).first
-                ==
-                finite_element.system_to_component_index(j).first)
-              data.local_matrix(i,j) += (eta *
-                                         (scratch.grads_phi_u[i] *
-                                          scratch.grads_phi_u[j])
-                                         +
-                                         (1./eta) *
-                                         pressure_scaling *
-                                         pressure_scaling *
-                                         (scratch.phi_p[i] * scratch.phi_p[j]))
-                                        * scratch.finite_element_values.JxW(q);
+        // only the velocity and pressure shape functions contribute to
+        // the preconditioner, and only within each vector component
+        for (unsigned int i_s=0; i_s<n_stokes_dofs; ++i_s)
+          for (unsigned int j_s=0; j_s<n_stokes_dofs; ++j_s)
+            {
+              const unsigned int i = scratch.stokes_dofs[i_s];
+              const unsigned int j = scratch.stokes_dofs[j_s];
+              if (finite_element.system_to_component_index(i).first
+                  ==
+                  finite_element.system_to_component_index(j).first)
+                data.local_matrix(i_s,j_s) += (eta *
+                                               (scratch.grads_phi_u[i] *
+                                                scratch.grads_phi_u[j])
+                                               +
+                                               (1./eta) *
+                                               pressure_scaling *
+                                               pressure_scaling *
+                                               (scratch.phi_p[i] * scratch.phi_p[j]))
+                                              * scratch.finite_element_values.JxW(q);
+            }
       }
 
-    cell->get_dof_indices (data.local_dof_indices);
+    cell->get_dof_indices (scratch.cell_dof_indices);
+    for (unsigned int i_s=0; i_s<n_stokes_dofs; ++i_s)
+      data.local_dof_indices[i_s] = scratch.cell_dof_indices[scratch.stokes_dofs[i_s]];
   }
 
 
@@ -969,6 +1011,25 @@ namespace aspect
 
     const QGauss<dim> quadrature_formula(parameters.stokes_velocity_degree+1);
 
+    // the preconditioner matrix only has velocity and pressure blocks,
+    // so only deal with the corresponding shape functions on each cell
+    internal::Assembly::Scratch::
+    StokesPreconditioner<dim> scratch (finite_element, quadrature_formula,
+                                       mapping,
+                                       update_JxW_values |
+                                       update_values |
+                                       update_gradients |
+                                       update_quadrature_points,
+                                       parameters.n_compositional_fields);
+    for (unsigned int i=0; i<finite_element.dofs_per_cell; ++i)
+      {
+        const unsigned int component = finite_element.system_to_component_index(i).first;
+        if (introspection.component_masks.velocities[component]
+            ||
+            introspection.component_masks.pressure[component])
+          scratch.stokes_dofs.push_back (i);
+      }
+
     typedef
     FilteredIterator<typename DoFHandler<dim>::active_cell_iterator>
     CellFilter;
@@ -988,16 +1049,9 @@ namespace aspect
                           copy_local_to_global_stokes_preconditioner,
                           this,
                           std_cxx1x::_1),
-         internal::Assembly::Scratch::
-         StokesPreconditioner<dim> (finite_element, quadrature_formula,
-                                    mapping,
-                                    update_JxW_values |
-                                    update_values |
-                                    update_gradients |
-                                    update_quadrature_points,
-                                    parameters.n_compositional_fields),
+         scratch,
          internal::Assembly::CopyData::
-         StokesPreconditioner<dim> (finite_element));
+         StokesPreconditioner<dim> (scratch.stokes_dofs.size()));
 
     system_preconditioner_matrix.compress(VectorOperation::add);
   }
@@ -1065,22 +1119,61 @@ namespace aspect
     const bool is_compressible = material_model->is_compressible();
 
     scratch.finite_element_values.reinit (cell);
+    cell->get_dof_indices (data.local_dof_indices);
 
-    if (rebuild_stokes_matrix)
+    // if we do not rebuild the matrix but boundary values may have changed
+    // since it was last built, we still need the local matrix on those
+    // cells that have inhomogeneously constrained degrees of freedom to
+    // get the right hand side right (see
+    // copy_local_to_global_stokes_system())
+    bool assemble_local_matrix = rebuild_stokes_matrix;
+    if (stokes_rhs_needs_local_matrices())
+      for (unsigned int i=0; i<dofs_per_cell; ++i)
+        if (current_constraints.is_inhomogeneously_constrained (data.local_dof_indices[i]))
+          {
+            assemble_local_matrix = true;
+            break;
+          }
+
+    if (rebuild_stokes_matrix || stokes_rhs_needs_local_matrices())
       data.local_matrix = 0;
     data.local_rhs = 0;
     if (do_pressure_rhs_compatibility_modification)
       data.local_pressure_shape_function_integrals = 0;
 
     // we only need the strain rates for the viscosity,
-    // which we only need when rebuilding the matrix
+    // which we only need when building the matrix
     compute_material_model_input_values (current_linearization_point,
                                          scratch.finite_element_values,
-                                         rebuild_stokes_matrix,
+                                         assemble_local_matrix,
                                          scratch.material_model_inputs);
 
     material_model->evaluate(scratch.material_model_inputs,scratch.material_model_outputs);
 
+    // for a Newton linearization, we also need the derivative of the
+    // viscosity with respect to the strain rate. we assume that the
+    // viscosity only depends on the magnitude of the strain rate, and
+    // compute the derivative with respect to that magnitude (times the
+    // magnitude itself) by evaluating the material model once more for
+    // slightly larger strain rates. the Newton terms change both matrix
+    // and right hand side, so we can only add them if we rebuild the
+    // matrix on all cells
+    const double newton_perturbation = 1e-6;
+    const bool assemble_newton_terms
+      = (rebuild_stokes_matrix
+         &&
+         (newton_derivative_scaling > 0)
+         &&
+         material_model->viscosity_depends_on (MaterialModel::NonlinearDependence::strain_rate));
+    if (assemble_newton_terms)
+      {
+        scratch.strain_rates = scratch.material_model_inputs.strain_rate;
+        for (unsigned int q=0; q<n_q_points; ++q)
+          scratch.material_model_inputs.strain_rate[q] *= (1 + newton_perturbation);
+        material_model->evaluate(scratch.material_model_inputs,scratch.perturbed_material_model_outputs);
+        scratch.material_model_inputs.strain_rate = scratch.strain_rates;
+      }
+
     scratch.finite_element_values[introspection.extractors.velocities].get_function_values(current_linearization_point,
         scratch.velocity_values);
 
@@ -1090,14 +1183,14 @@ namespace aspect
           {
             scratch.phi_u[k] = scratch.finite_element_values[introspection.extractors.velocities].value (k,q);
             scratch.phi_p[k] = scratch.finite_element_values[introspection.extractors.pressure].value (k, q);
-            if (rebuild_stokes_matrix)
+            if (assemble_local_matrix)
               {
                 scratch.grads_phi_u[k] = scratch.finite_element_values[introspection.extractors.velocities].symmetric_gradient(k,q);
                 scratch.div_phi_u[k]   = scratch.finite_element_values[introspection.extractors.velocities].divergence (k, q);
               }
           }
 
-        const double eta = (rebuild_stokes_matrix
+        const double eta = (assemble_local_matrix
                             ?
                             scratch.material_model_outputs.viscosities[q]
                             :
@@ -1114,7 +1207,7 @@ namespace aspect
              std::numeric_limits<double>::quiet_NaN() );
         const double density = scratch.material_model_outputs.densities[q];
 
-        if (rebuild_stokes_matrix)
+        if (assemble_local_matrix)
           for (unsigned int i=0; i<dofs_per_cell; ++i)
             for (unsigned int j=0; j<dofs_per_cell; ++j)
               data.local_matrix(i,j) += ( eta * 2.0 * (scratch.grads_phi_u[i] * scratch.grads_phi_u[j])
@@ -1129,6 +1222,63 @@ namespace aspect
                                              scratch.phi_p[i] * scratch.div_phi_u[j]))
                                         * scratch.finite_element_values.JxW(q);
 
+        // the Newton linearization of 2*eta(|eps(u)|)*eps(u) around the
+        // current linearization point u_k adds the term
+        //   2 * eta'/|eps_k| * (eps_k:eps(du)) * (eps_k:eps(v))
+        // to the matrix. since we solve for the new solution, not an
+        // update, we also have to add the same term applied to u_k to
+        // the right hand side. newton_derivative_scaling damps both.
+        //
+        // we need to keep the velocity block symmetric and positive
+        // definite since solve_stokes() inverts it with CG. for
+        // compressible models, we therefore use the deviator of eps_k in
+        // place of eps_k in both factors, rather than only in the one
+        // with the test function as the exact derivative would. the
+        // iteration then still converges to the same solution since the
+        // right hand side is modified consistently. furthermore, for
+        // viscosities that decrease with the strain rate (e.g., for
+        // yielding materials) the term reduces the effective viscosity in
+        // the direction of eps_k to eta + scaling * eta'*|eps_k|, which
+        // may be zero or negative. we limit the scaling at each
+        // quadrature point so that a fraction of eta remains
+        if (assemble_newton_terms)
+          {
+            const SymmetricTensor<2,dim> &strain_rate = scratch.strain_rates[q];
+            const double strain_rate_norm_square = strain_rate * strain_rate;
+            if (strain_rate_norm_square > 0)
+              {
+                // eta'(|eps|)*|eps|
+                const double viscosity_derivative
+                  = (scratch.perturbed_material_model_outputs.viscosities[q] - eta)
+                    / newton_perturbation;
+
+                const double minimal_viscosity_fraction = 0.1;
+                double scaling = newton_derivative_scaling;
+                if (scaling * viscosity_derivative < -(1-minimal_viscosity_fraction) * eta)
+                  scaling = -(1-minimal_viscosity_fraction) * eta / viscosity_derivative;
+
+                const SymmetricTensor<2,dim> newton_direction
+                  = (is_compressible ? deviator(strain_rate) : strain_rate);
+                const double factor = scaling * 2.0 * viscosity_derivative
+                                      / strain_rate_norm_square;
+                const double direction_times_strain_rate = newton_direction * strain_rate;
+
+                for (unsigned int i=0; i<dofs_per_cell; ++i)
+                  {
+                    const double test_term = newton_direction * scratch.grads_phi_u[i];
+
+                    data.local_rhs(i) += factor * direction_times_strain_rate * test_term
+                                         * scratch.finite_element_values.JxW(q);
+
+                    for (unsigned int j=0; j<dofs_per_cell; ++j)
+                      data.local_matrix(i,j) += factor
+                                                * (newton_direction * scratch.grads_phi_u[j])
+                                                * test_term
+                                                * scratch.finite_element_values.JxW(q);
+                  }
+              }
+          }
+
         for (unsigned int i=0; i<dofs_per_cell; ++i)
           data.local_rhs(i) += (
                                  (density * gravity * scratch.phi_u[i])
@@ -1148,7 +1298,20 @@ namespace aspect
       }
 
     free_surface_apply_stabilization(cell, data.local_matrix);
-    cell->get_dof_indices (data.local_dof_indices);
+  }
+
+
+
+  template <int dim>
+  bool
+  Simulator<dim>::
+  stokes_rhs_needs_local_matrices () const
+  {
+    return ((rebuild_stokes_matrix == false)
+            &&
+            parameters.reuse_stokes_matrix_with_prescribed_velocities
+            &&
+            !velocity_boundary_conditions.empty());
   }
 
 
@@ -1164,6 +1327,11 @@ namespace aspect
                                                       data.local_dof_indices,
                                                       system_matrix,
                                                       system_rhs);
+    else if (stokes_rhs_needs_local_matrices())
+      current_constraints.distribute_local_to_global (data.local_rhs,
+                                                      data.local_dof_indices,
+                                                      system_rhs,
+                                                      data.local_matrix);
     else
       current_constraints.distribute_local_to_global (data.local_rhs,
                                                       data.local_dof_indices,
@@ -1215,7 +1383,8 @@ namespace aspect
                             (update_values    |
                              update_quadrature_points  |
                              update_JxW_values |
-                             (rebuild_stokes_matrix == true
+                             ((rebuild_stokes_matrix == true)
+                              || stokes_rhs_needs_local_matrices()
                               ?
                               update_gradients
                               :
@@ -1649,6 +1818,7 @@ namespace aspect
     else
       {
         computing_timer.enter_section ("   Assemble composition system");
+        allocate_composition_matrix_block (temperature_or_composition.compositional_variable);
         system_matrix.block(3+temperature_or_composition.compositional_variable,
                             3+temperature_or_composition.compositional_variable) = 0;
       }
@@ -1752,6 +1922,7 @@ namespace aspect
                                                                internal::Assembly::CopyData::StokesSystem<dim> &data); \
   template void Simulator<dim>::copy_local_to_global_stokes_system ( \
                                                                      const internal::Assembly::CopyData::StokesSystem<dim> &data); \
+  template bool Simulator<dim>::stokes_rhs_needs_local_matrices () const; \
   template void Simulator<dim>::assemble_stokes_system (); \
   template void Simulator<dim>::get_artificial_viscosity (Vector<float> &viscosity_per_cell) const; \
   template void Simulator<dim>::build_advection_preconditioner (const TemperatureOrComposition &, \
@@ -23,10 +23,14 @@
 #include <aspect/simulator.h>
 
 #include <deal.II/base/mpi.h>
+#include <deal.II/base/thread_management.h>
+#include <deal.II/base/timer.h>
 #include <deal.II/grid/grid_tools.h>
 #include <deal.II/distributed/solution_transfer.h>
 
 #include <zlib.h>
+#include <cstdio>
+#include <cstring>
 
 namespace aspect
 {
@@ -44,6 +48,373 @@ namespace aspect
                                           +
                                           old_name + " -> " + new_name));
     }
+
+
+
+    /**
+     * Return whether a file with the given name exists.
+     */
+    bool file_exists (const std::string &filename)
+    {
+      std::ifstream in (filename.c_str());
+      return in;
+    }
+
+
+
+    /**
+     * Return the suffix we append to the names of the files of the
+     * generation-th old checkpoint (counting from one for the most recent
+     * one).
+     */
+    std::string old_checkpoint_suffix (const unsigned int generation)
+    {
+      if (generation == 1)
+        return ".old";
+      else
+        return ".old." + Utilities::int_to_string (generation);
+    }
+
+
+
+    /**
+     * The names (without directory) of the files that make up a
+     * checkpoint.
+     */
+    std::vector<std::string> checkpoint_file_names ()
+    {
+      std::vector<std::string> names;
+      names.push_back ("restart.mesh");
+      names.push_back ("restart.mesh.info");
+      names.push_back ("restart.resume.z");
+      names.push_back ("restart.checksums");
+      return names;
+    }
+
+
+
+    /**
+     * Compute the CRC32 checksum of the contents of the given file.
+     */
+    uLong file_checksum (const std::string &filename)
+    {
+      std::ifstream in (filename.c_str(), std::ios::binary);
+      AssertThrow (in, ExcMessage ("Can't open file <" + filename + "> to compute its checksum."));
+
+      uLong crc = crc32 (0L, Z_NULL, 0);
+      std::vector<char> buffer (1 << 20);
+      while (in)
+        {
+          in.read (&buffer[0], buffer.size());
+          if (in.gcount() > 0)
+            crc = crc32 (crc, (const Bytef *)&buffer[0], in.gcount());
+        }
+      return crc;
+    }
+
+
+
+    /**
+     * Write a file that contains the checksums of the mesh files of a
+     * checkpoint, one line per file with its name and checksum. As for
+     * the resume file, we write into a temporary file first that is then
+     * renamed, so that the checksum file is either complete or absent.
+     */
+    void write_checksum_file (const std::string &directory)
+    {
+      const std::string filename = directory + "restart.checksums";
+      const std::string tmp_filename = filename + ".tmp";
+      {
+        std::ofstream out (tmp_filename.c_str());
+        out << "restart.mesh " << file_checksum (directory + "restart.mesh") << '\n'
+            << "restart.mesh.info " << file_checksum (directory + "restart.mesh.info") << '\n';
+        out.close ();
+
+        AssertThrow (out, ExcMessage ("Writing the checksum file <" + tmp_filename + "> failed."));
+      }
+      AssertThrow (std::rename (tmp_filename.c_str(), filename.c_str()) == 0,
+                   ExcMessage ("Can't move file <" + tmp_filename + "> to <" + filename + ">."));
+    }
+
+
+
+    /**
+     * Verify the checksums stored in the checksum file of a checkpoint, if
+     * there is one. Return an empty string if they match, and an error
+     * message otherwise.
+     */
+    std::string verify_checksum_file (const std::string &directory)
+    {
+      std::ifstream in ((directory + "restart.checksums").c_str());
+      if (!in)
+        return "";
+
+      std::string name;
+      uLong checksum;
+      while (in >> name >> checksum)
+        if (file_checksum (directory + name) != checksum)
+          return ("The checksum of the file <" + directory + name +
+                  "> does not match the one stored when the checkpoint was "
+                  "created. The file appears to be corrupt.");
+
+      return "";
+    }
+
+
+
+    /**
+     * The size of the blocks into which we split the serialized state of
+     * the simulator before compression. Each block is compressed
+     * independently, which allows us to compress them in parallel and
+     * keeps all sizes stored in the file header below 4 GB, regardless of
+     * the total size of the data.
+     */
+    const uint32_t compression_block_size = 1U << 24;
+
+
+
+    /**
+     * Compress the given block of data with zlib and put the result into
+     * @p compressed_block.
+     */
+    void compress_block (const char         *data,
+                         const uint32_t      size,
+                         const int           compression_level,
+                         std::vector<char>  *compressed_block)
+    {
+      uLongf compressed_size = compressBound (size);
+      compressed_block->resize (compressed_size);
+      const int err = compress2 ((Bytef *) &(*compressed_block)[0],
+                                 &compressed_size,
+                                 (const Bytef *) data,
+                                 size,
+                                 compression_level);
+      AssertThrow (err == Z_OK, ExcInternalError());
+      compressed_block->resize (compressed_size);
+    }
+
+
+
+    /**
+     * Compress the given data and write it into the given file. The file
+     * starts with a header in the same format deal.II uses for compressed
+     * data in VTU files: the number of blocks, the size of each block
+     * before compression, the size of the last block before compression,
+     * and then the compressed size of each block, all as 32-bit integers.
+     * The header is followed by the compressed blocks.
+     *
+     * The data is first written to a temporary file that is then renamed,
+     * so that a file with the given name is always complete even if the
+     * program is terminated while writing.
+     *
+     * Since this function may be called on a separate thread, it takes a
+     * pointer to the data and deletes it at the end.
+     */
+    void write_compressed_file (const std::string  filename,
+                                const std::string *data,
+                                const int          compression_level)
+    {
+      const std::size_t total_size = data->size();
+      const unsigned int n_blocks
+        = std::max<std::size_t> ((total_size + compression_block_size - 1) / compression_block_size,
+                                 1);
+
+      // compress all blocks in parallel
+      std::vector<std::vector<char> > compressed_blocks (n_blocks);
+      Threads::TaskGroup<> tasks;
+      for (unsigned int b=0; b<n_blocks; ++b)
+        tasks += Threads::new_task (&compress_block,
+                                    data->data() + static_cast<std::size_t>(b) * compression_block_size,
+                                    static_cast<uint32_t>(std::min<std::size_t> (compression_block_size,
+                                                                                 total_size - static_cast<std::size_t>(b) * compression_block_size)),
+                                    compression_level,
+                                    &compressed_blocks[b]);
+      tasks.join_all ();
+
+      std::vector<uint32_t> compression_header (3+n_blocks);
+      compression_header[0] = n_blocks;
+      compression_header[1] = (n_blocks == 1
+                               ?
+                               static_cast<uint32_t>(total_size)
+                               :
+                               compression_block_size);
+      compression_header[2] = static_cast<uint32_t>(total_size -
+                                                    static_cast<std::size_t>(n_blocks-1) * compression_block_size);
+      for (unsigned int b=0; b<n_blocks; ++b)
+        compression_header[3+b] = compressed_blocks[b].size();
+
+      delete data;
+
+      const std::string tmp_filename = filename + ".tmp";
+      {
+        std::ofstream f (tmp_filename.c_str(), std::ios::binary);
+        f.write((const char *)&compression_header[0],
+                compression_header.size() * sizeof(compression_header[0]));
+        for (unsigned int b=0; b<n_blocks; ++b)
+          f.write(&compressed_blocks[b][0], compressed_blocks[b].size());
+        f.close ();
+
+        AssertThrow (f, ExcMessage ("Writing the checkpoint file <" + tmp_filename + "> failed."));
+      }
+      AssertThrow (std::rename (tmp_filename.c_str(), filename.c_str()) == 0,
+                   ExcMessage ("Can't move file <" + tmp_filename + "> to <" + filename + ">."));
+    }
+
+
+
+    /**
+     * Write the parts of a checkpoint that only the root process writes:
+     * the checksums of the mesh files that have already been written by
+     * all processes together, and the compressed state of the simulator.
+     *
+     * Since this function may run on a separate thread, where an exception
+     * would abort the program, errors are not reported by throwing an
+     * exception but by putting the error message into @p error_message.
+     */
+    void write_root_checkpoint_files (const std::string  directory,
+                                      const std::string *data,
+                                      const int          compression_level,
+                                      std::string       *error_message)
+    {
+      try
+        {
+          write_checksum_file (directory);
+          write_compressed_file (directory + "restart.resume.z", data, compression_level);
+        }
+      catch (std::exception &e)
+        {
+          *error_message = e.what();
+        }
+    }
+
+
+
+    /**
+     * Read the entire contents of the given file into a string, without
+     * interpreting them.
+     */
+    std::string read_file (const std::string &filename)
+    {
+      std::ifstream ifs (filename.c_str(), std::ios::binary);
+      AssertThrow(ifs.is_open(),
+                  ExcMessage("Cannot open snapshot resume file <" + filename + ">."));
+
+      ifs.seekg (0, std::ios::end);
+      std::string data (static_cast<std::size_t>(ifs.tellg()), '\0');
+      ifs.seekg (0, std::ios::beg);
+      if (data.size() > 0)
+        ifs.read (&data[0], data.size());
+      AssertThrow (ifs, ExcMessage ("Reading the snapshot resume file <" + filename + "> failed."));
+
+      return data;
+    }
+
+
+
+    /**
+     * Send the given string from the root process to all other processes.
+     * On the other processes, the previous contents of the string are
+     * replaced. Since MPI counts elements in signed integers, large strings
+     * are sent in several pieces.
+     */
+    void broadcast_string (std::string    &data,
+                           const MPI_Comm  mpi_communicator)
+    {
+      unsigned long long int size = data.size();
+      MPI_Bcast (&size, 1, MPI_UNSIGNED_LONG_LONG, 0, mpi_communicator);
+
+      if (Utilities::MPI::this_mpi_process (mpi_communicator) != 0)
+        data.assign (static_cast<std::size_t>(size), '\0');
+
+      const std::size_t max_chunk_size = 1U << 30;
+      for (std::size_t offset=0; offset<data.size(); offset+=max_chunk_size)
+        MPI_Bcast (&data[offset],
+                   static_cast<int>(std::min (max_chunk_size, data.size()-offset)),
+                   MPI_CHAR, 0, mpi_communicator);
+    }
+
+
+
+    /**
+     * Uncompress the contents of a file written by write_compressed_file()
+     * that have previously been read into memory. The file name is only
+     * used in error messages.
+     */
+    std::string uncompress_data (const std::string &compressed,
+                                 const std::string &filename)
+    {
+      AssertThrow (compressed.size() >= 3 * sizeof(uint32_t),
+                   ExcMessage ("The snapshot resume file <" + filename + "> is corrupt."));
+
+      uint32_t header[3];
+      std::memcpy (header, compressed.data(), 3 * sizeof(header[0]));
+      const unsigned int n_blocks = header[0];
+      AssertThrow ((n_blocks > 0)
+                   &&
+                   (compressed.size() >= (3 + static_cast<std::size_t>(n_blocks)) * sizeof(uint32_t)),
+                   ExcMessage ("The snapshot resume file <" + filename + "> is corrupt."));
+
+      std::vector<uint32_t> compressed_sizes (n_blocks);
+      std::memcpy (&compressed_sizes[0], compressed.data() + 3 * sizeof(header[0]),
+                   n_blocks * sizeof(compressed_sizes[0]));
+
+      std::string uncompressed (static_cast<std::size_t>(n_blocks-1) * header[1] + header[2], '\0');
+      std::size_t offset = (3 + static_cast<std::size_t>(n_blocks)) * sizeof(uint32_t);
+      for (unsigned int b=0; b<n_blocks; ++b)
+        {
+          AssertThrow (offset + compressed_sizes[b] <= compressed.size(),
+                       ExcMessage ("The snapshot resume file <" + filename + "> is truncated."));
+
+          const uLongf block_size = (b == n_blocks-1 ? header[2] : header[1]);
+          uLongf uncompressed_size = block_size;
+          const int err = uncompress((Bytef *)&uncompressed[static_cast<std::size_t>(b) * header[1]],
+                                     &uncompressed_size,
+                                     (const Bytef *)compressed.data() + offset, compressed_sizes[b]);
+          AssertThrow ((err == Z_OK) && (uncompressed_size == block_size),
+                       ExcMessage (std::string("Uncompressing the data buffer resulted in an error with code <")
+                                   +
+                                   Utilities::int_to_string(err)));
+          offset += compressed_sizes[b];
+        }
+
+      return uncompressed;
+    }
+
+
+
+    /**
+     * Return the number of processes on which the checkpoint in the given
+     * directory was written, as recorded by p4est in the restart.mesh.info
+     * file. Depending on the deal.II version, the file either starts
+     * directly with this number, or with a line of column names followed
+     * by a line that contains a format version number and then the number
+     * of processes. Return zero if the file can not be interpreted.
+     */
+    unsigned int n_processes_of_checkpoint (const std::string &directory)
+    {
+      std::ifstream in ((directory + "restart.mesh.info").c_str());
+      std::string first_token;
+      if (!(in >> first_token))
+        return 0;
+
+      unsigned int n_processes = 0;
+      if (first_token == "version")
+        {
+          std::string rest_of_line;
+          std::getline (in, rest_of_line);
+          unsigned int format_version;
+          if (!(in >> format_version >> n_processes))
+            return 0;
+        }
+      else
+        {
+          std::istringstream token (first_token);
+          if (!(token >> n_processes))
+            return 0;
+        }
+
+      return n_processes;
+    }
   }
 
 
@@ -53,28 +424,56 @@ namespace aspect
     computing_timer.enter_section ("Create snapshot");
     unsigned int my_id = Utilities::MPI::this_mpi_process (mpi_communicator);
 
+    // make sure the previous snapshot has been completely written
+    // before we move its files out of the way, and report if that failed
+    checkpoint_thread.join();
+    {
+      const std::string error_message = checkpoint_error_message;
+      checkpoint_error_message.clear();
+      AssertThrow (error_message.size() == 0,
+                   ExcMessage ("Writing the previous snapshot in the background failed: "
+                               + error_message));
+    }
+
     if (my_id == 0)
       {
-        // if we have previously written a snapshot, then keep the last
-        // snapshot in case this one fails to save
-        static bool previous_snapshot_exists = (parameters.resume_computation == true);
-
-        if (previous_snapshot_exists == true)
+        // if we have previously written a snapshot, then keep it (and as
+        // many older ones as requested) in case this one fails to save.
+        // first shift the older generations by one, dropping the oldest
+        const std::vector<std::string> file_names = checkpoint_file_names();
+        if (parameters.n_old_checkpoints > 0
+            &&
+            file_exists (parameters.output_directory + "restart.mesh"))
           {
-            move_file (parameters.output_directory + "restart.mesh",
-                       parameters.output_directory + "restart.mesh.old");
-            move_file (parameters.output_directory + "restart.mesh.info",
-                       parameters.output_directory + "restart.mesh.info.old");
-            move_file (parameters.output_directory + "restart.resume.z",
-                       parameters.output_directory + "restart.resume.z.old");
-
-            // from now on, we know that if we get into this
-            // function again that a snapshot has previously
-            // been written
-            previous_snapshot_exists = true;
+            for (unsigned int generation=parameters.n_old_checkpoints-1; generation>0; --generation)
+              for (unsigned int i=0; i<file_names.size(); ++i)
+                if (file_exists (parameters.output_directory + file_names[i]
+                                 + old_checkpoint_suffix(generation)))
+                  move_file (parameters.output_directory + file_names[i]
+                             + old_checkpoint_suffix(generation),
+                             parameters.output_directory + file_names[i]
+                             + old_checkpoint_suffix(generation+1));
+
+            for (unsigned int i=0; i<file_names.size(); ++i)
+              if (file_exists (parameters.output_directory + file_names[i]))
+                move_file (parameters.output_directory + file_names[i],
+                           parameters.output_directory + file_names[i]
+                           + old_checkpoint_suffix(1));
           }
+
+        // if we do not keep the previous snapshot, the files that are
+        // only written after the mesh (possibly in the background) would
+        // still describe the previous snapshot until they are replaced,
+        // and the checksums would then falsely indicate that the new mesh
+        // files are corrupt. remove them before writing anything
+        std::remove ((parameters.output_directory + "restart.checksums").c_str());
+        std::remove ((parameters.output_directory + "restart.resume.z").c_str());
       }
 
+    // make sure nobody writes the new mesh before the root process has
+    // moved the old files out of the way
+    MPI_Barrier (mpi_communicator);
+
     // save Triangulation and Solution vectors:
     {
       std::vector<const LinearAlgebra::BlockVector *> x_system (3);
@@ -100,31 +499,29 @@ namespace aspect
       aspect::oarchive oa (oss);
       oa << (*this);
 
-      // compress with zlib and write to file on the root processor
+      // compress with zlib and write to file on the root processor,
+      // possibly in the background while the computation continues
       if (my_id == 0)
         {
-          uLongf compressed_data_length = compressBound (oss.str().length());
-          std::vector<char *> compressed_data (compressed_data_length);
-          int err = compress2 ((Bytef *) &compressed_data[0],
-                               &compressed_data_length,
-                               (const Bytef *) oss.str().data(),
-                               oss.str().length(),
-                               Z_BEST_COMPRESSION);
-          Assert (err == Z_OK, ExcInternalError());
-
-          // build compression header
-          const uint32_t compression_header[4]
-            = { 1,                                   /* number of blocks */
-                (uint32_t)oss.str().length(), /* size of block */
-                (uint32_t)oss.str().length(), /* size of last block */
-                (uint32_t)compressed_data_length
-              }; /* list of compressed sizes of blocks */
-
-          std::ofstream f ((parameters.output_directory + "restart.resume.z").c_str());
-          f.write((const char *)compression_header, 4 * sizeof(compression_header[0]));
-          f.write((char *)&compressed_data[0], compressed_data_length);
+          if (parameters.checkpoint_in_background)
+            checkpoint_thread = Threads::new_thread (&write_root_checkpoint_files,
+                                                     parameters.output_directory,
+                                                     new std::string (oss.str()),
+                                                     parameters.checkpoint_compression_level,
+                                                     &checkpoint_error_message);
+          else
+            {
+              write_root_checkpoint_files (parameters.output_directory,
+                                           new std::string (oss.str()),
+                                           parameters.checkpoint_compression_level,
+                                           &checkpoint_error_message);
+
+              const std::string error_message = checkpoint_error_message;
+              checkpoint_error_message.clear();
+              AssertThrow (error_message.size() == 0,
+                           ExcMessage ("Writing the snapshot failed: " + error_message));
+            }
         }
-
     }
     pcout << "*** Snapshot created!" << std::endl << std::endl;
     computing_timer.exit_section();
@@ -163,65 +560,75 @@ namespace aspect
 
     pcout << "*** Resuming from snapshot!" << std::endl << std::endl;
 
+    // the checkpoint may have been written on a different number of
+    // processes than we are running on now. p4est redistributes the
+    // cells upon loading and setup_dofs() below then builds the
+    // degrees of freedom for the new partition, but it is worth letting
+    // the user know that this is happening
+    const unsigned int n_processes_now = Utilities::MPI::n_mpi_processes (mpi_communicator);
+    unsigned int n_processes_then = 0;
+    if (Utilities::MPI::this_mpi_process (mpi_communicator) == 0)
+      n_processes_then = n_processes_of_checkpoint (parameters.output_directory);
+    n_processes_then = Utilities::MPI::max (n_processes_then, mpi_communicator);
+    if ((n_processes_then != 0) && (n_processes_then != n_processes_now))
+      pcout << "     The snapshot was written on " << n_processes_then
+            << " processes and is now being resumed on " << n_processes_now
+            << " processes." << std::endl
+            << "     The mesh will be repartitioned." << std::endl << std::endl;
+
+    // keep track of how long the individual phases of the restart take,
+    // to be reported at the end
+    std::vector<std::pair<std::string,double> > phase_times;
+    Timer timer (mpi_communicator, true);
+
+    // verify that the mesh files have not been corrupted since they were
+    // written. only do this on one processor, since it requires reading
+    // the entire files, and let the others know about the result
+    {
+      std::string error_message;
+      if (Utilities::MPI::this_mpi_process (mpi_communicator) == 0)
+        error_message = verify_checksum_file (parameters.output_directory);
+
+      const unsigned int checksum_failed = Utilities::MPI::max (error_message.size() == 0 ? 0U : 1U,
+                                                                mpi_communicator);
+      AssertThrow (checksum_failed == 0,
+                   ExcMessage (error_message.size() > 0
+                               ?
+                               error_message
+                               :
+                               std::string ("The checksums of the checkpoint files do not match "
+                                            "the ones stored when the checkpoint was created.")));
+    }
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("Verifying checksums"), timer.wall_time()));
+
+    // read zlib compressed resume.z. only the root process reads the
+    // file and then sends its contents to everyone else, rather than
+    // having all processes hit the file system at the same time.
+    // we do this before loading the mesh and the solution vectors since
+    // deserializing this object verifies that the layout of the solution
+    // vectors stored in the snapshot matches the current input file.
+    // otherwise, SolutionTransfer::deserialize() would fail with a far
+    // less helpful error message
+    timer.restart ();
+    std::size_t compressed_size = 0;
+    std::size_t uncompressed_size = 0;
     try
       {
-        triangulation.load ((parameters.output_directory + "restart.mesh").c_str());
-      }
-    catch (...)
-      {
-        AssertThrow(false, ExcMessage("Cannot open snapshot mesh file or read the triangulation stored there."));
-      }
-    global_volume = GridTools::volume (triangulation, mapping);
-    setup_dofs();
-
-
-    LinearAlgebra::BlockVector
-    distributed_system (system_rhs);
-    LinearAlgebra::BlockVector
-    old_distributed_system (system_rhs);
-    LinearAlgebra::BlockVector
-    old_old_distributed_system (system_rhs);
-    std::vector<LinearAlgebra::BlockVector *> x_system (3);
-    x_system[0] = & (distributed_system);
-    x_system[1] = & (old_distributed_system);
-    x_system[2] = & (old_old_distributed_system);
-
-    parallel::distributed::SolutionTransfer<dim, LinearAlgebra::BlockVector>
-    system_trans (dof_handler);
+        const std::string filename = parameters.output_directory + "restart.resume.z";
 
-    system_trans.deserialize (x_system);
+        std::string compressed;
+        if (Utilities::MPI::this_mpi_process (mpi_communicator) == 0)
+          compressed = read_file (filename);
+        broadcast_string (compressed, mpi_communicator);
+        compressed_size = compressed.size();
 
-    solution = distributed_system;
-    old_solution = old_distributed_system;
-    old_old_solution = old_old_distributed_system;
-
-
-    // read zlib compressed resume.z
-    try
-      {
-        std::ifstream ifs ((parameters.output_directory + "restart.resume.z").c_str());
-        AssertThrow(ifs.is_open(),
-                    ExcMessage("Cannot open snapshot resume file."));
-
-        uint32_t compression_header[4];
-        ifs.read((char *)compression_header, 4 * sizeof(compression_header[0]));
-        Assert(compression_header[0]==1, ExcInternalError());
-
-        std::vector<char> compressed(compression_header[3]);
-        std::vector<char> uncompressed(compression_header[1]);
-        ifs.read(&compressed[0],compression_header[3]);
-        uLongf uncompressed_size = compression_header[1];
-
-        const int err = uncompress((Bytef *)&uncompressed[0], &uncompressed_size,
-                                   (Bytef *)&compressed[0], compression_header[3]);
-        AssertThrow (err == Z_OK,
-                     ExcMessage (std::string("Uncompressing the data buffer resulted in an error with code <")
-                                 +
-                                 Utilities::int_to_string(err)));
+        const std::string uncompressed = uncompress_data (compressed, filename);
+        uncompressed_size = uncompressed.size();
 
         {
           std::istringstream ss;
-          ss.str(std::string (&uncompressed[0], uncompressed_size));
+          ss.str(uncompressed);
           aspect::iarchive ia (ss);
           ia >> (*this);
         }
@@ -237,6 +644,73 @@ namespace aspect
                                  +
                                  ">"));
       }
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("Restoring the simulator state"), timer.wall_time()));
+
+    timer.restart ();
+    try
+      {
+        triangulation.load ((parameters.output_directory + "restart.mesh").c_str());
+      }
+    catch (...)
+      {
+        AssertThrow(false, ExcMessage("Cannot open snapshot mesh file or read the triangulation stored there."
+                                      +
+                                      ((n_processes_then != 0) && (n_processes_then != n_processes_now)
+                                       ?
+                                       std::string(" Note that the snapshot was written on ")
+                                       + Utilities::int_to_string (n_processes_then)
+                                       + " processes, but is being resumed on "
+                                       + Utilities::int_to_string (n_processes_now)
+                                       + " processes. The installed version of p4est "
+                                       "may not support changing the number of processes "
+                                       "upon restart."
+                                       :
+                                       std::string())));
+      }
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("Loading the mesh"), timer.wall_time()));
+
+    timer.restart ();
+    global_volume = GridTools::volume (triangulation, mapping);
+    setup_dofs();
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("Setting up degrees of freedom"), timer.wall_time()));
+
+    timer.restart ();
+    {
+      LinearAlgebra::BlockVector
+      distributed_system (system_rhs);
+      LinearAlgebra::BlockVector
+      old_distributed_system (system_rhs);
+      LinearAlgebra::BlockVector
+      old_old_distributed_system (system_rhs);
+      std::vector<LinearAlgebra::BlockVector *> x_system (3);
+      x_system[0] = & (distributed_system);
+      x_system[1] = & (old_distributed_system);
+      x_system[2] = & (old_old_distributed_system);
+
+      parallel::distributed::SolutionTransfer<dim, LinearAlgebra::BlockVector>
+      system_trans (dof_handler);
+
+      system_trans.deserialize (x_system);
+
+      solution = distributed_system;
+      old_solution = old_distributed_system;
+      old_old_solution = old_old_distributed_system;
+    }
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("Restoring solution vectors"), timer.wall_time()));
+
+    pcout << "     Restored " << triangulation.n_global_active_cells()
+          << " cells and " << dof_handler.n_dofs()
+          << " degrees of freedom; the simulator state took "
+          << compressed_size << " bytes on disk ("
+          << uncompressed_size << " bytes uncompressed)." << std::endl;
+    for (unsigned int i=0; i<phase_times.size(); ++i)
+      pcout << "     " << phase_times[i].first << ": "
+            << phase_times[i].second << " s" << std::endl;
+    pcout << std::endl;
 
     // re-initialize the postprocessors with the current object
     postprocess_manager.initialize (*this);
@@ -247,6 +721,8 @@ namespace aspect
 //why do we need this?!
 BOOST_CLASS_TRACKING (aspect::Simulator<2>, boost::serialization::track_never)
 BOOST_CLASS_TRACKING (aspect::Simulator<3>, boost::serialization::track_never)
+BOOST_CLASS_VERSION (aspect::Simulator<2>, 1)
+BOOST_CLASS_VERSION (aspect::Simulator<3>, 1)
 
 
 namespace aspect
@@ -254,7 +730,7 @@ namespace aspect
 
   template <int dim>
   template<class Archive>
-  void Simulator<dim>::serialize (Archive &ar, const unsigned int)
+  void Simulator<dim>::serialize (Archive &ar, const unsigned int version)
   {
     ar &time;
     ar &time_step;
@@ -263,6 +739,38 @@ namespace aspect
 
     ar &postprocess_manager &statistics;
 
+    // starting with version 1, also store the parameters that determine
+    // the layout of the solution vectors. upon restart, verify that they
+    // have not changed since the solution vectors could otherwise not
+    // be interpreted correctly
+    if (version > 0)
+      {
+        unsigned int n_compositional_fields  = parameters.n_compositional_fields;
+        unsigned int stokes_velocity_degree  = parameters.stokes_velocity_degree;
+        unsigned int temperature_degree      = parameters.temperature_degree;
+        unsigned int composition_degree      = parameters.composition_degree;
+        bool         locally_conservative    = parameters.use_locally_conservative_discretization;
+
+        ar &n_compositional_fields;
+        ar &stokes_velocity_degree;
+        ar &temperature_degree;
+        ar &composition_degree;
+        ar &locally_conservative;
+
+        AssertThrow ((n_compositional_fields == parameters.n_compositional_fields)
+                     &&
+                     (stokes_velocity_degree == parameters.stokes_velocity_degree)
+                     &&
+                     (temperature_degree == parameters.temperature_degree)
+                     &&
+                     (composition_degree == parameters.composition_degree)
+                     &&
+                     (locally_conservative == parameters.use_locally_conservative_discretization),
+                     ExcMessage ("The snapshot was created with a different number of "
+                                 "compositional fields or different finite elements than "
+                                 "the ones selected in the current input file. Resuming "
+                                 "from it is not possible."));
+      }
   }
 }
 
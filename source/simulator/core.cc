@@ -26,9 +26,12 @@
 #include <deal.II/base/index_set.h>
 #include <deal.II/base/conditional_ostream.h>
 #include <deal.II/base/quadrature_lib.h>
+#include <deal.II/base/timer.h>
 #include <deal.II/lac/constraint_matrix.h>
 #include <deal.II/lac/block_sparsity_pattern.h>
 #include <deal.II/lac/sparsity_tools.h>
+#include <deal.II/lac/full_matrix.h>
+#include <deal.II/lac/vector.h>
 #include <deal.II/grid/grid_tools.h>
 
 #include <deal.II/dofs/dof_renumbering.h>
@@ -50,8 +53,11 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <cstring>
+#include <cmath>
 #include <locale>
 #include <string>
+#include <deque>
 
 
 using namespace dealii;
@@ -96,6 +102,11 @@ namespace aspect
     computing_timer (pcout, TimerOutput::summary,
                      TimerOutput::wall_times),
 
+    statistics_rows_written (0),
+    depth_average_cache_enabled (false),
+    depth_average_n_slices (0),
+    last_refinement_indicator_norm (0),
+
     geometry_model (GeometryModel::create_geometry_model<dim>(prm)),
     material_model (MaterialModel::create_material_model<dim>(prm)),
     gravity_model (GravityModel::create_gravity_model<dim>(prm)),
@@ -116,6 +127,9 @@ namespace aspect
     time_step (0),
     old_time_step (0),
     timestep_number (0),
+    temporal_error_estimate (0),
+    old_temporal_error_estimate (0),
+    n_rejected_time_steps (0),
 
     triangulation (mpi_communicator,
                    typename Triangulation<dim>::MeshSmoothing
@@ -142,6 +156,9 @@ namespace aspect
 
     dof_handler (triangulation),
 
+    composition_matrix_block (numbers::invalid_unsigned_int),
+    adaptive_linear_solver_tolerance (0),
+    newton_derivative_scaling (0),
     rebuild_stokes_matrix (true),
     rebuild_stokes_preconditioner (true),
     free_surface_fe (FE_Q<dim>(1),dim),
@@ -338,6 +355,14 @@ namespace aspect
     // wait if there is a thread that's still writing the statistics
     // object (set from the output_statistics() function)
     output_statistics_thread.join();
+
+    // likewise for a checkpoint that may still be written. we can't
+    // throw an exception from a destructor, so just let the user know
+    // if that failed
+    checkpoint_thread.join();
+    if (checkpoint_error_message.size() > 0)
+      std::cerr << "Writing the last snapshot failed: "
+                << checkpoint_error_message << std::endl;
   }
 
 
@@ -485,6 +510,16 @@ namespace aspect
                            introspection.system_dofs_per_block[3]);
 
 
+    // if requested, keep a copy of the constraints of the previous time
+    // step to find out below whether the Stokes matrix needs to be rebuilt.
+    // there is nothing to find out if we rebuild it anyway, for example
+    // because the mesh has changed
+    std_cxx1x::shared_ptr<ConstraintMatrix> old_constraints;
+    if (parameters.reuse_stokes_matrix_with_prescribed_velocities
+        && !velocity_boundary_conditions.empty()
+        && (rebuild_stokes_matrix == false))
+      old_constraints.reset (new ConstraintMatrix (current_constraints));
+
     // then interpolate the current boundary velocities. this adds to
     // the current_constraints object we already have
     {
@@ -542,8 +577,46 @@ namespace aspect
     // to make sure that the time dependent velocity boundary conditions
     // end up in the right hand side in the right way; we currently do
     // that by re-assembling the entire system
+    //
+    // if requested, we only do so if the set of constrained degrees of
+    // freedom or the constraints between them have changed. the global
+    // matrix does not depend on the values of the constraints, and
+    // assemble_stokes_system() then takes changed boundary values into
+    // account through the right hand side
     if (!velocity_boundary_conditions.empty())
-      rebuild_stokes_matrix = rebuild_stokes_preconditioner = true;
+      {
+        bool constraints_changed = true;
+        if (old_constraints)
+          {
+            unsigned int local_changes = 0;
+            const IndexSet &relevant_set = introspection.index_sets.system_relevant_set;
+            for (unsigned int i=0; i<relevant_set.n_elements(); ++i)
+              {
+                const types::global_dof_index index = relevant_set.nth_index_in_set (i);
+                if (current_constraints.is_constrained (index)
+                    != old_constraints->is_constrained (index))
+                  {
+                    local_changes = 1;
+                    break;
+                  }
+
+                const std::vector<std::pair<types::global_dof_index,double> > *
+                new_entries = current_constraints.get_constraint_entries (index);
+                const std::vector<std::pair<types::global_dof_index,double> > *
+                old_entries = old_constraints->get_constraint_entries (index);
+                if ((new_entries != 0) && (*new_entries != *old_entries))
+                  {
+                    local_changes = 1;
+                    break;
+                  }
+              }
+            constraints_changed
+              = (Utilities::MPI::max (local_changes, mpi_communicator) != 0);
+          }
+
+        if (constraints_changed)
+          rebuild_stokes_matrix = rebuild_stokes_preconditioner = true;
+      }
 
     // notify different system components that we started the next time step
     material_model->update();
@@ -559,6 +632,28 @@ namespace aspect
   {
     system_matrix.clear ();
 
+    // all compositional fields use the same finite element and, because
+    // we number degrees of freedom component-wise, generally also the
+    // same numbering within their respective blocks. since only one of
+    // them is assembled and solved at any given time, we then only
+    // allocate the matrix block of the first one here and later move
+    // its sparsity pattern to the block of whatever field we assemble
+    // next (see allocate_composition_matrix_block()). the memory for the
+    // compositional field matrices then does not grow with the number
+    // of fields
+    composition_matrix_block = numbers::invalid_unsigned_int;
+#ifndef USE_PETSC
+    if (parameters.n_compositional_fields > 1)
+      {
+        composition_matrix_block = introspection.block_indices.compositional_fields[0];
+        for (unsigned int c=1; c<parameters.n_compositional_fields; ++c)
+          if (system_partitioning[introspection.block_indices.compositional_fields[c]]
+              !=
+              system_partitioning[composition_matrix_block])
+            composition_matrix_block = numbers::invalid_unsigned_int;
+      }
+#endif
+
     Table<2,DoFTools::Coupling> coupling (introspection.n_components,
                                           introspection.n_components);
 
@@ -584,8 +679,11 @@ namespace aspect
         }
       coupling[x.temperature][x.temperature] = DoFTools::always;
       for (unsigned int c=0; c<parameters.n_compositional_fields; ++c)
-        coupling[x.compositional_fields[c]][x.compositional_fields[c]]
-          = DoFTools::always;
+        if ((composition_matrix_block == numbers::invalid_unsigned_int)
+            ||
+            (c == 0))
+          coupling[x.compositional_fields[c]][x.compositional_fields[c]]
+            = DoFTools::always;
     }
 
 #ifdef USE_PETSC
@@ -619,6 +717,40 @@ namespace aspect
 
 
 
+  template <int dim>
+  void
+  Simulator<dim>::
+  allocate_composition_matrix_block (const unsigned int compositional_variable)
+  {
+#ifndef USE_PETSC
+    const unsigned int block = introspection.block_indices.compositional_fields[compositional_variable];
+    if ((composition_matrix_block == numbers::invalid_unsigned_int)
+        ||
+        (composition_matrix_block == block))
+      return;
+
+    // the preconditioner may still refer to the block we are about to
+    // release, so get rid of it first. it is rebuilt after assembly anyway
+    C_preconditioner.reset ();
+
+    // copy the sparsity pattern to the block of the field we are about
+    // to assemble, and replace the previous block by one without entries
+    system_matrix.block(block,block).reinit (system_matrix.block(composition_matrix_block,
+                                                                 composition_matrix_block));
+
+    TrilinosWrappers::SparsityPattern
+    empty_pattern (introspection.index_sets.system_partitioning[composition_matrix_block],
+                   mpi_communicator, 0);
+    empty_pattern.compress ();
+    system_matrix.block(composition_matrix_block,
+                        composition_matrix_block).reinit (empty_pattern);
+
+    composition_matrix_block = block;
+#endif
+  }
+
+
+
   template <int dim>
   void Simulator<dim>::
   setup_system_preconditioner (const std::vector<IndexSet> &system_partitioning)
@@ -630,15 +762,26 @@ namespace aspect
 
     system_preconditioner_matrix.clear ();
 
+    // the preconditioner only uses the velocity-velocity and the
+    // pressure-pressure blocks of this matrix, and within the former
+    // only the couplings between the same vector components. so
+    // only allocate these parts and leave the temperature and
+    // compositional field blocks empty
     Table<2,DoFTools::Coupling> coupling (introspection.n_components,
                                           introspection.n_components);
-    for (unsigned int c=0; c<introspection.n_components; ++c)
-      for (unsigned int d=0; d<introspection.n_components; ++d)
-        if (c == d)
-          coupling[c][d] = DoFTools::always;
-        else
+    {
+      const typename Introspection<dim>::ComponentIndices &x
+        = introspection.component_indices;
+
+      for (unsigned int c=0; c<introspection.n_components; ++c)
+        for (unsigned int d=0; d<introspection.n_components; ++d)
           coupling[c][d] = DoFTools::none;
 
+      for (unsigned int d=0; d<dim; ++d)
+        coupling[x.velocities[d]][x.velocities[d]] = DoFTools::always;
+      coupling[x.pressure][x.pressure] = DoFTools::always;
+    }
+
 
 #ifdef USE_PETSC
     LinearAlgebra::CompressedBlockSparsityPattern sp(introspection.index_sets.system_relevant_partitioning);
@@ -676,6 +819,11 @@ namespace aspect
 
     dof_handler.distribute_dofs(finite_element);
 
+    // the mesh has changed, so the information we store about the
+    // points at which we compute depth averages is no longer valid
+    depth_average_slices.clear();
+    depth_average_JxW.clear();
+
     // Renumber the DoFs hierarchical so that we get the
     // same numbering if we resume the computation. This
     // is because the numbering depends on the order the
@@ -943,11 +1091,20 @@ namespace aspect
     computing_timer.enter_section ("Postprocessing");
     pcout << "   Postprocessing:" << std::endl;
 
+    // the solution does not change while the postprocessors run, so
+    // depth averages requested by more than one of them only need to
+    // be computed once
+    depth_average_cache.clear ();
+    depth_average_cache_enabled = true;
+
     // run all the postprocessing routines and then write
     // the current state of the statistics table to a file
     std::list<std::pair<std::string,std::string> >
     output_list = postprocess_manager.execute (statistics);
 
+    depth_average_cache_enabled = false;
+    depth_average_cache.clear ();
+
     // if we are on processor zero, print to screen
     // whatever the postprocessors have generated
     if (Utilities::MPI::this_mpi_process(mpi_communicator)==0)
@@ -983,19 +1140,350 @@ namespace aspect
   }
 
 
+  namespace
+  {
+    /**
+     * A class that transfers the solution vectors of the Stokes/advection
+     * system and the vectors that describe the mesh deformation of the
+     * free surface to a refined mesh at the same time. It does the same
+     * as two objects of type parallel::distributed::SolutionTransfer, one
+     * for each DoFHandler, but packs the data of both into a single
+     * buffer per cell so that p4est only has to move the data around
+     * once.
+     */
+    template <int dim>
+    class CombinedSolutionTransfer
+    {
+      public:
+        /**
+         * Constructor.
+         */
+        CombinedSolutionTransfer (parallel::distributed::Triangulation<dim> &triangulation,
+                                  const DoFHandler<dim>                      &system_dof_handler,
+                                  const DoFHandler<dim>                      &mesh_dof_handler);
+
+        /**
+         * Store the given vectors so that they can be packed into the
+         * buffers of each cell once the triangulation is refined. This
+         * function has to be called after
+         * Triangulation::prepare_coarsening_and_refinement() and before
+         * Triangulation::execute_coarsening_and_refinement().
+         */
+        void
+        prepare_for_coarsening_and_refinement (const std::vector<const LinearAlgebra::BlockVector *> &system_vectors,
+                                               const std::vector<const LinearAlgebra::Vector *>      &mesh_vectors);
+
+        /**
+         * Interpolate the data stored before refinement into the given
+         * vectors, which must not have ghost elements and must already
+         * have been initialized with the partitioning of the new mesh.
+         */
+        void
+        interpolate (const std::vector<LinearAlgebra::BlockVector *> &system_vectors,
+                     const std::vector<LinearAlgebra::Vector *>      &mesh_vectors);
+
+      private:
+        parallel::distributed::Triangulation<dim> &triangulation;
+        const DoFHandler<dim>                     &system_dof_handler;
+        const DoFHandler<dim>                     &mesh_dof_handler;
+
+        std::vector<const LinearAlgebra::BlockVector *> input_system_vectors;
+        std::vector<const LinearAlgebra::Vector *>      input_mesh_vectors;
+
+        /**
+         * The offset of our data in the buffers p4est attaches to each
+         * cell, as returned by Triangulation::register_data_attach().
+         */
+        unsigned int offset;
+
+        /**
+         * Temporary storage for the values of one cell, kept around so
+         * that we do not have to allocate memory for every cell.
+         */
+        Vector<double> system_cell_values;
+        Vector<double> mesh_cell_values;
+
+        void pack_callback (const typename parallel::distributed::Triangulation<dim>::cell_iterator &cell,
+                            const typename parallel::distributed::Triangulation<dim>::CellStatus status,
+                            void *data);
+
+        void unpack_callback (const typename parallel::distributed::Triangulation<dim>::cell_iterator &cell,
+                              const typename parallel::distributed::Triangulation<dim>::CellStatus status,
+                              const void *data,
+                              const std::vector<LinearAlgebra::BlockVector *> &system_vectors,
+                              const std::vector<LinearAlgebra::Vector *>      &mesh_vectors);
+    };
+
+
+
+    template <int dim>
+    CombinedSolutionTransfer<dim>::
+    CombinedSolutionTransfer (parallel::distributed::Triangulation<dim> &triangulation,
+                              const DoFHandler<dim>                      &system_dof_handler,
+                              const DoFHandler<dim>                      &mesh_dof_handler)
+      :
+      triangulation (triangulation),
+      system_dof_handler (system_dof_handler),
+      mesh_dof_handler (mesh_dof_handler),
+      offset (numbers::invalid_unsigned_int),
+      system_cell_values (system_dof_handler.get_fe().dofs_per_cell),
+      mesh_cell_values (mesh_dof_handler.get_fe().dofs_per_cell)
+    {}
+
+
+
+    template <int dim>
+    void
+    CombinedSolutionTransfer<dim>::
+    prepare_for_coarsening_and_refinement (const std::vector<const LinearAlgebra::BlockVector *> &system_vectors,
+                                           const std::vector<const LinearAlgebra::Vector *>      &mesh_vectors)
+    {
+      input_system_vectors = system_vectors;
+      input_mesh_vectors   = mesh_vectors;
+
+      const std::size_t size
+        = sizeof(double) * (input_system_vectors.size() * system_cell_values.size()
+                            +
+                            input_mesh_vectors.size() * mesh_cell_values.size());
+      offset = triangulation.register_data_attach (size,
+                                                   std_cxx1x::bind (&CombinedSolutionTransfer<dim>::pack_callback,
+                                                                    this,
+                                                                    std_cxx1x::_1,
+                                                                    std_cxx1x::_2,
+                                                                    std_cxx1x::_3));
+    }
+
+
+
+    template <int dim>
+    void
+    CombinedSolutionTransfer<dim>::
+    interpolate (const std::vector<LinearAlgebra::BlockVector *> &system_vectors,
+                 const std::vector<LinearAlgebra::Vector *>      &mesh_vectors)
+    {
+      Assert (system_vectors.size() == input_system_vectors.size(), ExcInternalError());
+      Assert (mesh_vectors.size() == input_mesh_vectors.size(), ExcInternalError());
+
+      triangulation.notify_ready_to_unpack (offset,
+                                            std_cxx1x::bind (&CombinedSolutionTransfer<dim>::unpack_callback,
+                                                             this,
+                                                             std_cxx1x::_1,
+                                                             std_cxx1x::_2,
+                                                             std_cxx1x::_3,
+                                                             std_cxx1x::cref(system_vectors),
+                                                             std_cxx1x::cref(mesh_vectors)));
+
+      for (unsigned int i=0; i<system_vectors.size(); ++i)
+        system_vectors[i]->compress (VectorOperation::insert);
+      for (unsigned int i=0; i<mesh_vectors.size(); ++i)
+        mesh_vectors[i]->compress (VectorOperation::insert);
+
+      input_system_vectors.clear ();
+      input_mesh_vectors.clear ();
+    }
+
+
+
+    template <int dim>
+    void
+    CombinedSolutionTransfer<dim>::
+    pack_callback (const typename parallel::distributed::Triangulation<dim>::cell_iterator &cell,
+                   const typename parallel::distributed::Triangulation<dim>::CellStatus /*status*/,
+                   void *data)
+    {
+      double *data_store = reinterpret_cast<double *>(data);
+
+      // for cells that are going to be coarsened, we get called on the
+      // parent cell; get_interpolated_dof_values() then interpolates
+      // from the children, so all cases can be treated alike
+      const typename DoFHandler<dim>::cell_iterator
+      system_cell (&triangulation, cell->level(), cell->index(), &system_dof_handler);
+      for (unsigned int i=0; i<input_system_vectors.size(); ++i)
+        {
+          system_cell->get_interpolated_dof_values (*input_system_vectors[i], system_cell_values);
+          std::memcpy (data_store, &system_cell_values(0), sizeof(double)*system_cell_values.size());
+          data_store += system_cell_values.size();
+        }
+
+      const typename DoFHandler<dim>::cell_iterator
+      mesh_cell (&triangulation, cell->level(), cell->index(), &mesh_dof_handler);
+      for (unsigned int i=0; i<input_mesh_vectors.size(); ++i)
+        {
+          mesh_cell->get_interpolated_dof_values (*input_mesh_vectors[i], mesh_cell_values);
+          std::memcpy (data_store, &mesh_cell_values(0), sizeof(double)*mesh_cell_values.size());
+          data_store += mesh_cell_values.size();
+        }
+    }
+
+
+
+    template <int dim>
+    void
+    CombinedSolutionTransfer<dim>::
+    unpack_callback (const typename parallel::distributed::Triangulation<dim>::cell_iterator &cell,
+                     const typename parallel::distributed::Triangulation<dim>::CellStatus /*status*/,
+                     const void *data,
+                     const std::vector<LinearAlgebra::BlockVector *> &system_vectors,
+                     const std::vector<LinearAlgebra::Vector *>      &mesh_vectors)
+    {
+      const double *data_store = reinterpret_cast<const double *>(data);
+
+      // for cells that have been refined, we get called on the parent
+      // cell; set_dof_values_by_interpolation() then sets the values
+      // on the children
+      const typename DoFHandler<dim>::cell_iterator
+      system_cell (&triangulation, cell->level(), cell->index(), &system_dof_handler);
+      for (unsigned int i=0; i<system_vectors.size(); ++i)
+        {
+          std::memcpy (&system_cell_values(0), data_store, sizeof(double)*system_cell_values.size());
+          system_cell->set_dof_values_by_interpolation (system_cell_values, *system_vectors[i]);
+          data_store += system_cell_values.size();
+        }
+
+      const typename DoFHandler<dim>::cell_iterator
+      mesh_cell (&triangulation, cell->level(), cell->index(), &mesh_dof_handler);
+      for (unsigned int i=0; i<mesh_vectors.size(); ++i)
+        {
+          std::memcpy (&mesh_cell_values(0), data_store, sizeof(double)*mesh_cell_values.size());
+          mesh_cell->set_dof_values_by_interpolation (mesh_cell_values, *mesh_vectors[i]);
+          data_store += mesh_cell_values.size();
+        }
+    }
+  }
+
+
+
+  template <int dim>
+  std::pair<double,double>
+  fractions_for_target_n_cells (const double n_cells,
+                                const double target_n_cells,
+                                const double refinement_fraction,
+                                const double coarsening_fraction)
+  {
+    Assert (n_cells > 0, ExcInternalError());
+
+    // refining a cell adds 2^dim-1 cells, coarsening 2^dim cells into
+    // their parent removes 2^dim-1 of them. the mesh thus grows by
+    //   n_cells * (r*(2^dim-1) - c*(2^dim-1)/2^dim)
+    // cells if we refine a fraction r and coarsen a fraction c of all cells
+    const double refine_growth  = (1<<dim) - 1;
+    const double coarsen_shrink = refine_growth / (1<<dim);
+    const double growth         = target_n_cells / n_cells - 1;
+
+    double refine  = refinement_fraction;
+    double coarsen = coarsening_fraction;
+    if (growth > refine * refine_growth - coarsen * coarsen_shrink)
+      {
+        // we need more cells than the given fractions would yield, so
+        // coarsen less and, if that is not enough, refine more
+        coarsen = (refine * refine_growth - growth) / coarsen_shrink;
+        if (coarsen < 0)
+          {
+            coarsen = 0;
+            refine  = growth / refine_growth;
+          }
+      }
+    else
+      {
+        // we need fewer cells, so refine less and, if that is not enough,
+        // coarsen more
+        refine = (growth + coarsen * coarsen_shrink) / refine_growth;
+        if (refine < 0)
+          {
+            refine  = 0;
+            coarsen = -growth / coarsen_shrink;
+          }
+      }
+
+    refine  = std::max (0., std::min (refine, 1.));
+    coarsen = std::max (0., std::min (coarsen, 1.-refine));
+
+    return std::make_pair (refine, coarsen);
+  }
+
+
+
   template <int dim>
   void Simulator<dim>::refine_mesh (const unsigned int max_grid_level)
   {
+    Timer timer (mpi_communicator, true);
+    std::vector<std::pair<std::string,double> > phase_times;
+
     computing_timer.enter_section ("Refine mesh structure, part 1");
 
     Vector<float> estimated_error_per_cell (triangulation.n_active_cells());
     mesh_refinement_manager.execute (estimated_error_per_cell);
 
-    parallel::distributed::GridRefinement::
-    refine_and_coarsen_fixed_fraction (triangulation,
-                                       estimated_error_per_cell,
-                                       parameters.refinement_fraction,
-                                       parameters.coarsening_fraction);
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("computing error indicators"), timer.wall_time()));
+    timer.restart ();
+
+    // if given a target size for the mesh, convert it into a number of
+    // cells
+    const double n_cells = triangulation.n_global_active_cells();
+    double target_n_cells = 0;
+    if (parameters.refinement_target_n_cells > 0)
+      target_n_cells = parameters.refinement_target_n_cells;
+    if (parameters.refinement_target_dofs_per_process > 0)
+      {
+        const double target_from_dofs
+          = 1. * parameters.refinement_target_dofs_per_process
+            * Utilities::MPI::n_mpi_processes (mpi_communicator)
+            * n_cells / dof_handler.n_dofs();
+        target_n_cells = (target_n_cells > 0
+                          ?
+                          std::min (target_n_cells, target_from_dofs)
+                          :
+                          target_from_dofs);
+      }
+
+    // see whether we can skip this refinement step because the error
+    // indicators have not changed much since the last time we refined
+    // and the mesh is already about the size we want it to be
+    if (parameters.refinement_skip_threshold > 0)
+      {
+        const double indicator_norm
+          = std::sqrt (Utilities::MPI::sum (estimated_error_per_cell.norm_sqr(),
+                                            mpi_communicator));
+
+        if ((last_refinement_indicator_norm > 0)
+            &&
+            (std::fabs (indicator_norm - last_refinement_indicator_norm)
+             <= parameters.refinement_skip_threshold * last_refinement_indicator_norm)
+            &&
+            ((target_n_cells == 0)
+             ||
+             (std::fabs (n_cells - target_n_cells)
+              <= parameters.refinement_skip_threshold * target_n_cells)))
+          {
+            pcout << "   Skipping mesh refinement: the error indicators have "
+                  << "not changed significantly." << std::endl;
+            computing_timer.exit_section();
+            return;
+          }
+
+        last_refinement_indicator_norm = indicator_norm;
+      }
+
+    if (target_n_cells > 0)
+      {
+        const std::pair<double,double> fractions
+          = fractions_for_target_n_cells<dim> (n_cells, target_n_cells,
+                                               parameters.refinement_fraction,
+                                               parameters.coarsening_fraction);
+
+        parallel::distributed::GridRefinement::
+        refine_and_coarsen_fixed_number (triangulation,
+                                         estimated_error_per_cell,
+                                         fractions.first,
+                                         fractions.second);
+      }
+    else
+      parallel::distributed::GridRefinement::
+      refine_and_coarsen_fixed_fraction (triangulation,
+                                         estimated_error_per_cell,
+                                         parameters.refinement_fraction,
+                                         parameters.coarsening_fraction);
 
     // limit maximum refinement level
     if (triangulation.n_levels() > max_grid_level)
@@ -1016,29 +1504,37 @@ namespace aspect
     x_system[2] = &mesh_velocity;
     x_system[3] = &old_mesh_velocity;
 
-    parallel::distributed::SolutionTransfer<dim,LinearAlgebra::BlockVector>
-    system_trans(dof_handler);
-
     std::vector<const LinearAlgebra::Vector *> x_fs_system (1);
     x_fs_system[0] = &mesh_vertices;
 
-    parallel::distributed::SolutionTransfer<dim,LinearAlgebra::Vector>
-        freesurface_trans(free_surface_dof_handler);
-
+    // transfer the solution and the mesh deformation in a single sweep
+    CombinedSolutionTransfer<dim> solution_trans (triangulation,
+                                                  dof_handler,
+                                                  free_surface_dof_handler);
 
     triangulation.prepare_coarsening_and_refinement();
-    system_trans.prepare_for_coarsening_and_refinement(x_system);
-    freesurface_trans.prepare_for_coarsening_and_refinement(x_fs_system);
+    solution_trans.prepare_for_coarsening_and_refinement(x_system, x_fs_system);
 
     triangulation.execute_coarsening_and_refinement ();
     global_volume = GridTools::volume (triangulation, mapping);
     computing_timer.exit_section();
 
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("refining the mesh"), timer.wall_time()));
+    timer.restart ();
+
     setup_dofs ();
 
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("setting up degrees of freedom"), timer.wall_time()));
+    timer.restart ();
+
     computing_timer.enter_section ("Refine mesh structure, part 2");
 
     {
+      // the vectors we interpolate into need to be without ghost
+      // elements. they take their layout from system_rhs, which
+      // setup_dofs() has already initialized for the new mesh
       LinearAlgebra::BlockVector
       distributed_system (system_rhs);
       LinearAlgebra::BlockVector
@@ -1054,30 +1550,196 @@ namespace aspect
       system_tmp[2] = &(distributed_mesh_velocity);
       system_tmp[3] = &(old_distributed_mesh_velocity);
 
-      system_trans.interpolate (system_tmp);
-      solution     = distributed_system;
-      old_solution = old_distributed_system;
-      mesh_velocity = distributed_mesh_velocity;
+      LinearAlgebra::Vector
+      distributed_mesh_vertices (mesh_locally_owned, mpi_communicator);
+
+      std::vector<LinearAlgebra::Vector *> fs_system_tmp (1);
+      fs_system_tmp[0] = &(distributed_mesh_vertices);
+
+      solution_trans.interpolate (system_tmp, fs_system_tmp);
+
+      solution          = distributed_system;
+      old_solution      = old_distributed_system;
+      mesh_velocity     = distributed_mesh_velocity;
       old_mesh_velocity = old_distributed_mesh_velocity;
+      mesh_vertices     = distributed_mesh_vertices;
     }
 
+    free_surface_displace_mesh ();
+
+    computing_timer.exit_section();
+
+    timer.stop ();
+    phase_times.push_back (std::make_pair (std::string("transferring the solution"), timer.wall_time()));
+
+    if (parameters.report_refinement_times)
+      {
+        pcout << "   Mesh refinement took";
+        for (unsigned int i=0; i<phase_times.size(); ++i)
+          pcout << (i == 0 ? " " : ", ")
+                << phase_times[i].second << "s " << phase_times[i].first;
+        pcout << '.' << std::endl;
+      }
+  }
+
+
+  namespace
+  {
+    /**
+     * A class that implements Anderson acceleration of a fixed point
+     * iteration $x_{k+1}=G(x_k)$. Given the current iterate $x_k$ and
+     * $G(x_k)$, it computes the next iterate as the combination of
+     * $G(x_k)$ and the results of the previous few iterations for which
+     * the (linearized) difference $G(x)-x$ is smallest.
+     *
+     * Since the solution vector contains quantities of very different
+     * magnitude, differences are measured relative to the size of each
+     * block of the solution of the first iteration.
+     */
+    class AndersonAcceleration
     {
-      LinearAlgebra::Vector
-       distributed_mesh_vertices;
-      distributed_mesh_vertices.reinit(mesh_locally_owned, mpi_communicator);
+      public:
+        /**
+         * Constructor. The depth is the number of previous iterations that
+         * are taken into account.
+         */
+        AndersonAcceleration (const unsigned int depth);
+
+        /**
+         * Given the current iterate and the result of one fixed point
+         * iteration started from it, replace the latter by the accelerated
+         * next iterate. Both vectors must not have ghost elements.
+         */
+        void accelerate (const LinearAlgebra::BlockVector &iterate,
+                         LinearAlgebra::BlockVector       &next_iterate);
+
+      private:
+        double inner_product (const LinearAlgebra::BlockVector &a,
+                              const LinearAlgebra::BlockVector &b) const;
+
+        const unsigned int                     depth;
+        std::vector<double>                    block_weights;
+        std::deque<LinearAlgebra::BlockVector> delta_residuals;
+        std::deque<LinearAlgebra::BlockVector> delta_results;
+        LinearAlgebra::BlockVector             old_residual;
+        LinearAlgebra::BlockVector             old_result;
+    };
+
+
+
+    AndersonAcceleration::AndersonAcceleration (const unsigned int depth)
+      :
+      depth (depth)
+    {}
 
-      std::vector<LinearAlgebra::Vector *> system_tmp (1);
-       system_tmp[0] = &(distributed_mesh_vertices);
-       freesurface_trans.interpolate (system_tmp);
-       mesh_vertices     = distributed_mesh_vertices;
+
+
+    double
+    AndersonAcceleration::inner_product (const LinearAlgebra::BlockVector &a,
+                                         const LinearAlgebra::BlockVector &b) const
+    {
+      double result = 0;
+      for (unsigned int block=0; block<a.n_blocks(); ++block)
+        result += block_weights[block] * (a.block(block) * b.block(block));
+      return result;
     }
 
-    free_surface_displace_mesh ();
 
-    computing_timer.exit_section();
+
+    void
+    AndersonAcceleration::accelerate (const LinearAlgebra::BlockVector &iterate,
+                                      LinearAlgebra::BlockVector       &next_iterate)
+    {
+      if (block_weights.size() == 0)
+        for (unsigned int block=0; block<next_iterate.n_blocks(); ++block)
+          {
+            const double norm = next_iterate.block(block).l2_norm();
+            block_weights.push_back (norm > 0 ? 1./(norm*norm) : 1.);
+          }
+
+      LinearAlgebra::BlockVector residual (next_iterate);
+      residual -= iterate;
+
+      if (old_residual.n_blocks() > 0)
+        {
+          delta_residuals.push_back (residual);
+          delta_residuals.back() -= old_residual;
+          delta_results.push_back (next_iterate);
+          delta_results.back() -= old_result;
+
+          if (delta_residuals.size() > depth)
+            {
+              delta_residuals.pop_front ();
+              delta_results.pop_front ();
+            }
+        }
+      old_residual = residual;
+      old_result   = next_iterate;
+
+      if (delta_residuals.size() == 0)
+        return;
+
+      // find the coefficients that minimize the norm of the
+      // linearized residual by solving the normal equations of this
+      // small least squares problem. regularize them slightly since
+      // the differences of successive residuals tend to be close to
+      // linearly dependent
+      const unsigned int m = delta_residuals.size();
+      FullMatrix<double> matrix (m, m);
+      Vector<double>     rhs (m);
+      Vector<double>     coefficients (m);
+      for (unsigned int i=0; i<m; ++i)
+        {
+          for (unsigned int j=0; j<=i; ++j)
+            matrix(i,j) = matrix(j,i) = inner_product (delta_residuals[i], delta_residuals[j]);
+          rhs(i) = inner_product (delta_residuals[i], residual);
+        }
+
+      double trace = 0;
+      for (unsigned int i=0; i<m; ++i)
+        trace += matrix(i,i);
+      if (trace == 0)
+        return;
+      for (unsigned int i=0; i<m; ++i)
+        matrix(i,i) += 1e-10 * trace / m;
+
+      matrix.gauss_jordan ();
+      matrix.vmult (coefficients, rhs);
+
+      for (unsigned int i=0; i<m; ++i)
+        next_iterate.add (-coefficients(i), delta_results[i]);
+    }
+
+
+
+    /**
+     * Compute the relative tolerance for the linear solvers in the next
+     * nonlinear iteration from the current and previous nonlinear residual
+     * and the previous tolerance, following the second choice of Eisenstat
+     * and Walker.
+     */
+    double
+    adaptive_linear_tolerance (const double residual,
+                               const double old_residual,
+                               const double old_tolerance)
+    {
+      const double gamma         = 0.9;
+      const double alpha         = 2;
+      const double max_tolerance = 0.1;
+
+      double tolerance = gamma * std::pow (residual/old_residual, alpha);
+
+      // do not let the tolerance decrease much faster than the residual
+      const double safeguard = gamma * std::pow (old_tolerance, alpha);
+      if (safeguard > 0.1)
+        tolerance = std::max (tolerance, safeguard);
+
+      return std::min (tolerance, max_tolerance);
+    }
   }
 
 
+
   template <int dim>
   void
   Simulator<dim>::
@@ -1100,6 +1762,17 @@ namespace aspect
         current_linearization_point = distr_solution;
       }
 
+    // the nonlinear iterations start out with the Newton linearization of
+    // the Stokes equation if so requested, and fall back to the Picard
+    // linearization below if the Stokes residual grows
+    newton_derivative_scaling = ((parameters.use_newton_linearization
+                                  &&
+                                  (parameters.nonlinear_solver != NonlinearSolver::IMPES))
+                                 ?
+                                 parameters.newton_derivative_scaling_factor
+                                 :
+                                 0);
+
     switch (parameters.nonlinear_solver)
       {
         case NonlinearSolver::IMPES:
@@ -1142,10 +1815,28 @@ namespace aspect
         }
         case NonlinearSolver::Stokes_only:
         {
+          std_cxx1x::shared_ptr<AndersonAcceleration> acceleration;
+          if (parameters.nonlinear_acceleration_depth > 0)
+            acceleration.reset (new AndersonAcceleration (parameters.nonlinear_acceleration_depth));
+
+          double initial_stokes_residual  = 0;
+          double old_stokes_residual      = 0;
+          double previous_stokes_residual = 0;
+          if (parameters.use_adaptive_linear_solver_tolerance)
+            adaptive_linear_solver_tolerance = 0.1;
+
           unsigned int iteration = 0;
 
           do
             {
+              // remember where this iteration started from
+              LinearAlgebra::BlockVector iterate;
+              if (acceleration)
+                {
+                  iterate.reinit (system_rhs);
+                  iterate = current_linearization_point;
+                }
+
               // the Stokes matrix depends on the viscosity. if the viscosity
               // depends on other solution variables, then we need to
               // update the Stokes matrix in every iteration and so need to set
@@ -1159,10 +1850,14 @@ namespace aspect
               // but if we have to repeat computing the right hand side, we need to
               // also rebuild the matrix if we end up with inhomogenous velocity
               // boundary conditions (i.e., if there are prescribed velocity boundary
-              // indicators)
+              // indicators). that is, unless we are asked to reuse the matrix
+              // in that case, since assemble_stokes_system() then computes
+              // the local matrices it needs to get the right hand side right
               if ((stokes_matrix_depends_on_solution() == true)
                   ||
-                  (parameters.prescribed_velocity_boundary_indicators.size() > 0))
+                  ((parameters.prescribed_velocity_boundary_indicators.size() > 0)
+                   &&
+                   (parameters.reuse_stokes_matrix_with_prescribed_velocities == false)))
                 rebuild_stokes_matrix = true;
               if (stokes_matrix_depends_on_solution() == true)
                 rebuild_stokes_preconditioner = true;
@@ -1176,6 +1871,31 @@ namespace aspect
               if (stokes_residual < 1e-8)
                 break;
 
+              if ((iteration > 0) && (stokes_residual > previous_stokes_residual))
+                fall_back_to_picard_linearization ();
+              previous_stokes_residual = stokes_residual;
+
+              if (iteration == 0)
+                initial_stokes_residual = old_stokes_residual = stokes_residual;
+
+              if (parameters.use_adaptive_linear_solver_tolerance)
+                {
+                  adaptive_linear_solver_tolerance
+                    = adaptive_linear_tolerance (stokes_residual/initial_stokes_residual,
+                                                 old_stokes_residual/initial_stokes_residual,
+                                                 adaptive_linear_solver_tolerance);
+                  old_stokes_residual = stokes_residual;
+                }
+
+              // start the next iteration from the accelerated iterate
+              if (acceleration)
+                {
+                  LinearAlgebra::BlockVector next_iterate (system_rhs);
+                  next_iterate = solution;
+                  acceleration->accelerate (iterate, next_iterate);
+                  current_linearization_point = next_iterate;
+                }
+
               ++iteration;
             }
           while (iteration < parameters.max_nonlinear_iterations);
@@ -1187,12 +1907,29 @@ namespace aspect
         {
           double initial_temperature_residual = 0;
           double initial_stokes_residual      = 0;
+          double previous_stokes_residual     = 0;
           std::vector<double> initial_composition_residual (parameters.n_compositional_fields,0);
 
+          std_cxx1x::shared_ptr<AndersonAcceleration> acceleration;
+          if (parameters.nonlinear_acceleration_depth > 0)
+            acceleration.reset (new AndersonAcceleration (parameters.nonlinear_acceleration_depth));
+
+          double old_relative_residual = 1;
+          if (parameters.use_adaptive_linear_solver_tolerance)
+            adaptive_linear_solver_tolerance = 0.1;
+
           unsigned int iteration = 0;
 
           do
             {
+              // remember where this iteration started from
+              LinearAlgebra::BlockVector iterate;
+              if (acceleration)
+                {
+                  iterate.reinit (system_rhs);
+                  iterate = current_linearization_point;
+                }
+
               assemble_advection_system(TemperatureOrComposition::temperature());
 
               if (iteration == 0)
@@ -1242,6 +1979,11 @@ namespace aspect
               pcout << std::endl
                     << std::endl;
 
+              if ((iteration > 0) && (stokes_residual > previous_stokes_residual))
+                fall_back_to_picard_linearization ();
+              previous_stokes_residual = stokes_residual;
+
+              double relative_residual = 1;
               if (iteration == 0)
                 {
                   initial_temperature_residual = temperature_residual;
@@ -1259,6 +2001,25 @@ namespace aspect
                   pcout << "      residual: " << max << std::endl;
                   if (max < parameters.nonlinear_tolerance)
                     break;
+                  relative_residual = max;
+                }
+
+              if (parameters.use_adaptive_linear_solver_tolerance)
+                {
+                  adaptive_linear_solver_tolerance
+                    = adaptive_linear_tolerance (relative_residual,
+                                                 old_relative_residual,
+                                                 adaptive_linear_solver_tolerance);
+                  old_relative_residual = relative_residual;
+                }
+
+              // start the next iteration from the accelerated iterate
+              if (acceleration)
+                {
+                  LinearAlgebra::BlockVector next_iterate (system_rhs);
+                  next_iterate = solution;
+                  acceleration->accelerate (iterate, next_iterate);
+                  current_linearization_point = next_iterate;
                 }
 
               ++iteration;
@@ -1295,14 +2056,19 @@ namespace aspect
           LinearAlgebra::Vector tmp (introspection.index_sets.system_partitioning[0], mpi_communicator);
 
           // ...and then iterate the solution of the Stokes system
-          double initial_stokes_residual = 0;
+          double initial_stokes_residual  = 0;
+          double previous_stokes_residual = 0;
           for (unsigned int i=0; i< parameters.max_nonlinear_iterations; ++i)
             {
               // rebuild the matrix if it actually depends on the solution
-              // of the previous iteration.
+              // of the previous iteration, or if there are prescribed
+              // velocities and we are not asked to reuse the matrix in
+              // that case (see the Stokes_only case above)
               if ((stokes_matrix_depends_on_solution() == true)
                   ||
-                  (parameters.prescribed_velocity_boundary_indicators.size() > 0))
+                  ((parameters.prescribed_velocity_boundary_indicators.size() > 0)
+                   &&
+                   (parameters.reuse_stokes_matrix_with_prescribed_velocities == false)))
                 rebuild_stokes_matrix = rebuild_stokes_preconditioner = true;
 
               assemble_stokes_system();
@@ -1318,7 +2084,11 @@ namespace aspect
                     {
                       break; // convergence reached, exist nonlinear iteration.
                     }
+
+                  if (stokes_residual > previous_stokes_residual)
+                    fall_back_to_picard_linearization ();
                 }
+              previous_stokes_residual = stokes_residual;
 
               current_linearization_point.block(introspection.block_indices.velocities)
                 = solution.block(introspection.block_indices.velocities);
@@ -1335,9 +2105,105 @@ namespace aspect
         default:
           Assert (false, ExcNotImplemented());
       }
+
+    // any linear solves outside the nonlinear iterations above use
+    // the tolerances given in the input file again
+    adaptive_linear_solver_tolerance = 0;
+    newton_derivative_scaling = 0;
   }
 
 
+
+  template <int dim>
+  void
+  Simulator<dim>::
+  fall_back_to_picard_linearization ()
+  {
+    if (newton_derivative_scaling == 0)
+      return;
+
+    pcout << "      Stokes residual increased, switching from Newton to Picard linearization"
+          << std::endl;
+    newton_derivative_scaling = 0;
+  }
+
+
+
+  template <int dim>
+  void
+  Simulator<dim>::
+  solve_timestep_with_error_control ()
+  {
+    // a rejected time step adds the statistics of the solvers to the
+    // statistics table just like an accepted one, so remember how long
+    // the columns of the table were so that we can remove these entries
+    // again
+    const std::map<std::string,unsigned int> statistics_column_lengths
+      = get_statistics_column_lengths ();
+
+    // each rejection reduces the time step by at least 10%, and usually
+    // by much more. if we still cannot satisfy the tolerance after this
+    // many attempts, something else is wrong
+    const unsigned int max_rejections_per_time_step = 20;
+    unsigned int n_rejections = 0;
+
+    while (true)
+      {
+        solve_timestep ();
+
+        // we can only estimate the error once there are two previous
+        // time steps from which solve_timestep() extrapolated
+        if (timestep_number <= 1)
+          break;
+
+        const double error_estimate = compute_temporal_error_estimate ();
+        if (error_estimate <= 1)
+          {
+            // store the estimate, but keep it away from zero, which
+            // indicates that no estimate is available
+            old_temporal_error_estimate = temporal_error_estimate;
+            temporal_error_estimate     = std::max (error_estimate, 1e-10);
+            break;
+          }
+
+        // reject the time step: reduce the step size as much as the
+        // error estimate suggests (but not by more than a factor of
+        // five) and solve again. the estimate is proportional to the
+        // square of the time step, see compute_temporal_error_estimate()
+        ++n_rejections;
+        AssertThrow (n_rejections <= max_rejections_per_time_step,
+                     ExcMessage ("The time step has been rejected "
+                                 + Utilities::int_to_string (max_rejections_per_time_step)
+                                 + " times in a row because the estimated temporal error "
+                                 "remained larger than the 'Temporal error tolerance'. "
+                                 "The tolerance may be too small for the accuracy with "
+                                 "which the linear and nonlinear systems are solved."));
+        ++n_rejected_time_steps;
+        const double reduced_time_step
+          = time_step * std::max (0.2,
+                                  0.9 * std::pow (1./error_estimate, 1./2));
+
+        if (parameters.convert_to_years == true)
+          pcout << "   Rejecting time step of size " << time_step/year_in_seconds
+                << " years (relative error estimate " << error_estimate
+                << "), trying " << reduced_time_step/year_in_seconds
+                << " years instead." << std::endl;
+        else
+          pcout << "   Rejecting time step of size " << time_step
+                << " seconds (relative error estimate " << error_estimate
+                << "), trying " << reduced_time_step
+                << " seconds instead." << std::endl;
+
+        time_step = reduced_time_step;
+        truncate_statistics (statistics_column_lengths);
+      }
+
+    statistics.add_value ("Relative temporal error estimate", temporal_error_estimate);
+    statistics.add_value ("Number of rejected time steps", n_rejected_time_steps);
+  }
+
+
+
   /**
    * This is the main function of the program, containing the overall
    * logic which function is called when.
@@ -1384,11 +2250,21 @@ namespace aspect
       {
         computing_timer.enter_section ("Initialization");
         set_initial_temperature_and_compositional_fields ();
-        compute_initial_pressure_field ();
+
+        // if we come back here after one of the initial refinement
+        // cycles and have been asked to reuse the previous solution,
+        // then old_solution already contains the pressure interpolated
+        // from the previous mesh, which is a better guess than the
+        // adiabatic pressure
+        if ((pre_refinement_step == 0)
+            ||
+            (parameters.reuse_solution_on_initial_refinement == false))
+          compute_initial_pressure_field ();
 
         time                      = parameters.start_time;
         timestep_number           = 0;
         time_step = old_time_step = 0;
+        temporal_error_estimate = old_temporal_error_estimate = 0;
         computing_timer.exit_section();
       }
 
@@ -1398,7 +2274,10 @@ namespace aspect
         start_timestep ();
 
         // then do the core work: assemble systems and solve
-        solve_timestep ();
+        if (parameters.use_temporal_error_control)
+          solve_timestep_with_error_control ();
+        else
+          solve_timestep ();
 
         pcout << std::endl;
 
@@ -1407,7 +2286,11 @@ namespace aspect
         // returned by compute_time_step is unused, will be
         // added to statistics later
         old_time_step = time_step;
-        time_step = std::min (compute_time_step().first,
+        time_step = std::min ((parameters.use_temporal_error_control
+                               ?
+                               compute_controlled_time_step()
+                               :
+                               compute_time_step().first),
                               parameters.maximum_time_step);
         time_step = termination_manager.check_for_last_time_step(time_step);
 
@@ -1427,6 +2310,18 @@ namespace aspect
             if (parameters.run_postprocessors_on_initial_refinement)
               postprocess ();
 
+            // solve_timestep() takes its starting guess from old_solution,
+            // which refine_mesh() interpolates onto the new mesh. so if we
+            // want to reuse the velocity and pressure just computed, put
+            // them there
+            if (parameters.reuse_solution_on_initial_refinement)
+              {
+                old_solution.block(introspection.block_indices.velocities)
+                  = solution.block(introspection.block_indices.velocities);
+                old_solution.block(introspection.block_indices.pressure)
+                  = solution.block(introspection.block_indices.pressure);
+              }
+
             refine_mesh (max_refinement_level);
             ++pre_refinement_step;
             goto start_time_iteration;
@@ -1510,6 +2405,13 @@ namespace aspect
             (timestep_number % parameters.checkpoint_steps == 0))
           do_checkpoint = true;
 
+        // Independently, see if the model time has passed a multiple of the
+        // model time interval between checkpoints during the last step
+        if ((parameters.checkpoint_model_time > 0) &&
+            (std::floor(time/parameters.checkpoint_model_time) >
+             std::floor((time-time_step)/parameters.checkpoint_model_time)))
+          do_checkpoint = true;
+
         // Do a checkpoint either if indicated by checkpoint parameters, or if this
         // is the end of simulation and the termination criteria say to checkpoint
         if (do_checkpoint || (termination.first && termination.second))
@@ -1529,6 +2431,10 @@ namespace aspect
           break;
       }
     while (true);
+
+    // also write the last row of the statistics, which we have held
+    // back so far if the statistics are written incrementally
+    output_statistics (true);
   }
 }
 
@@ -1538,7 +2444,11 @@ namespace aspect
 namespace aspect
 {
 #define INSTANTIATE(dim) \
-  template class Simulator<dim>;
+  template class Simulator<dim>; \
+  template \
+  std::pair<double,double> \
+  fractions_for_target_n_cells<dim> (const double, const double, \
+                                     const double, const double);
 
   ASPECT_INSTANTIATE(INSTANTIATE)
 }
@@ -507,6 +507,10 @@ namespace aspect
                        ); //enforce the vertex position
           }
 
+    // the locations of the points at which we compute depth averages
+    // have changed
+    depth_average_slices.clear();
+    depth_average_JxW.clear();
   }
 
   template <int dim>
@@ -46,9 +46,11 @@
 #include <deal.II/distributed/solution_transfer.h>
 #include <deal.II/distributed/grid_refinement.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <locale>
 #include <string>
 
@@ -174,11 +176,218 @@ namespace aspect
       // delete the copy now:
       delete copy_of_table;
     }
+
+
+
+    /**
+     * A class that gives access to the data stored in a TableHandler
+     * object, which the TableHandler class itself only exposes through
+     * functions that write the entire table. We use this to format only
+     * those rows of the statistics table that have not been written yet,
+     * and to remove the entries of rejected time steps.
+     *
+     * The members of the base class are accessed through pointers to
+     * members, which is the only way a derived class can access protected
+     * members of objects that are not of the derived type.
+     */
+    class StatisticsTableAccessor : public TableHandler
+    {
+      public:
+        /**
+         * Return the names of the columns in the order in which they were
+         * created.
+         */
+        static
+        const std::vector<std::string> &
+        get_column_order (const TableHandler &table)
+        {
+          return table.*(&StatisticsTableAccessor::column_order);
+        }
+
+        /**
+         * Return the number of rows of the table. Even in auto fill mode,
+         * a column is only padded once a value is added to it, so columns
+         * that are not written to in every row may be shorter than others.
+         * The number of rows is the length of the longest column.
+         */
+        static
+        unsigned int
+        n_rows (const TableHandler &table)
+        {
+          const std::map<std::string,Column> &columns
+            = table.*(&StatisticsTableAccessor::columns);
+
+          unsigned int n = 0;
+          for (std::map<std::string,Column>::const_iterator
+               p = columns.begin(); p != columns.end(); ++p)
+            n = std::max<unsigned int> (n, p->second.entries.size());
+          return n;
+        }
+
+        /**
+         * Return the number of entries in each column of the table.
+         */
+        static
+        std::map<std::string,unsigned int>
+        column_lengths (const TableHandler &table)
+        {
+          const std::map<std::string,Column> &columns
+            = table.*(&StatisticsTableAccessor::columns);
+
+          std::map<std::string,unsigned int> lengths;
+          for (std::map<std::string,Column>::const_iterator
+               p = columns.begin(); p != columns.end(); ++p)
+            lengths[p->first] = p->second.entries.size();
+          return lengths;
+        }
+
+        /**
+         * Shorten the columns of the table to the given lengths, and
+         * remove the columns for which no length is given.
+         */
+        static
+        void
+        truncate (TableHandler                             &table,
+                  const std::map<std::string,unsigned int> &lengths)
+        {
+          std::map<std::string,Column> &columns
+            = table.*(&StatisticsTableAccessor::columns);
+          std::vector<std::string> &column_order
+            = table.*(&StatisticsTableAccessor::column_order);
+
+          for (std::map<std::string,Column>::iterator
+               p = columns.begin(); p != columns.end(); )
+            if (lengths.find (p->first) == lengths.end())
+              {
+                column_order.erase (std::find (column_order.begin(),
+                                               column_order.end(),
+                                               p->first));
+                columns.erase (p++);
+              }
+            else
+              {
+                const unsigned int length = lengths.find (p->first)->second;
+                if (p->second.entries.size() > length)
+                  {
+                    p->second.entries.erase (p->second.entries.begin() + length,
+                                             p->second.entries.end());
+                    p->second.invalidate_cache ();
+                  }
+                ++p;
+              }
+        }
+
+        /**
+         * Format the rows starting with @p first_row and ending before
+         * @p end_row and append them to @p out. Entries are separated by
+         * @p separator, and empty entries (including those missing at the
+         * end of columns shorter than the table) are represented by
+         * @p empty_entry. If @p trailing_separator is true, every entry
+         * (including the last one in a row) is followed by the separator,
+         * as in the files TableHandler writes itself.
+         */
+        static
+        void
+        write_rows (const TableHandler &table,
+                    const unsigned int  first_row,
+                    const unsigned int  end_row,
+                    const char          separator,
+                    const std::string  &empty_entry,
+                    const bool          trailing_separator,
+                    std::ostream       &out)
+        {
+          const std::map<std::string,Column> &columns
+            = table.*(&StatisticsTableAccessor::columns);
+          const std::vector<std::string> &column_order
+            = get_column_order (table);
+
+          for (unsigned int row=first_row; row<end_row; ++row)
+            {
+              for (unsigned int j=0; j<column_order.size(); ++j)
+                {
+                  const Column &column = columns.find(column_order[j])->second;
+
+                  if (row < column.entries.size())
+                    column.entries[row].cache_string (column.scientific,
+                                                      column.precision);
+                  if ((row >= column.entries.size())
+                      ||
+                      (column.entries[row].get_cached_string().size() == 0))
+                    out << empty_entry;
+                  else
+                    out << column.entries[row].get_cached_string();
+
+                  if (trailing_separator || (j+1 < column_order.size()))
+                    out << separator;
+                }
+              out << '\n';
+            }
+        }
+    };
+
+
+
+    /**
+     * Write the given text into a file. If @p append is true, the text is
+     * appended to the existing file. Otherwise, it replaces the contents of
+     * the file, which we do by writing a temporary file that is then moved
+     * into place, for the same reasons as in do_output_statistics().
+     *
+     * This function is called in the background, so the text is passed as
+     * a pointer to an object that is deleted at the end of this function.
+     */
+    void write_statistics_text (const std::string  file_name,
+                                const std::string *text,
+                                const bool         append)
+    {
+      if (append)
+        {
+          std::ofstream file (file_name.c_str(), std::ios::app);
+          file << *text;
+        }
+      else
+        {
+          const std::string tmp_file_name = file_name + " tmp";
+
+          std::ofstream file (tmp_file_name.c_str());
+          file << *text;
+          file.close();
+
+          std::rename(tmp_file_name.c_str(), file_name.c_str());
+        }
+
+      delete text;
+    }
+
+
+
+    /**
+     * Write the new contents of the statistics file and, if requested, of
+     * the CSV file. The statistics file is either written from the given
+     * copy of the entire table, or from the given text if the table pointer
+     * is null. A null pointer for the CSV text indicates that no CSV file
+     * is to be written.
+     */
+    void do_output_statistics_incrementally (const std::string   stat_file_name,
+                                             const TableHandler *copy_of_table,
+                                             const std::string  *stat_text,
+                                             const std::string   csv_file_name,
+                                             const std::string  *csv_text,
+                                             const bool          append)
+    {
+      if (copy_of_table != 0)
+        do_output_statistics (stat_file_name, copy_of_table);
+      else if (stat_text != 0)
+        write_statistics_text (stat_file_name, stat_text, append);
+
+      if (csv_text != 0)
+        write_statistics_text (csv_file_name, csv_text, append);
+    }
   }
 
 
   template <int dim>
-  void Simulator<dim>::output_statistics()
+  void Simulator<dim>::output_statistics (const bool write_all_rows)
   {
     // only write the statistics file from processor zero
     if (Utilities::MPI::this_mpi_process(mpi_communicator)!=0)
@@ -204,9 +413,100 @@ namespace aspect
     // make sure that the previous thread is done or they'll
     // stomp on each other's feet
     output_statistics_thread.join();
-    output_statistics_thread = Threads::new_thread (&do_output_statistics,
+
+    if ((parameters.append_to_statistics_file == false)
+        &&
+        (parameters.write_statistics_csv_file == false))
+      {
+        output_statistics_thread = Threads::new_thread (&do_output_statistics,
+                                                        parameters.output_directory+"statistics",
+                                                        new TableHandler(statistics));
+        return;
+      }
+
+    // otherwise only format the rows we have not written yet, unless the
+    // set of columns has changed since the last time (or we have not yet
+    // written anything, e.g. because we have just resumed from a
+    // checkpoint), in which case we need to write the header and all rows
+    // again
+    const std::vector<std::string> &columns
+      = StatisticsTableAccessor::get_column_order (statistics);
+    const bool append = (columns == statistics_columns_written);
+    const unsigned int first_row = (append ? statistics_rows_written : 0);
+
+    // values may still be added to the last row of the table after this
+    // function has been called (e.g., by the postprocessors during the
+    // initial refinement cycles), so we hold it back until the next row
+    // has been started or we are asked to write everything
+    const unsigned int n_rows = StatisticsTableAccessor::n_rows (statistics);
+    const unsigned int end_row = ((write_all_rows || (n_rows == 0))
+                                  ?
+                                  n_rows
+                                  :
+                                  std::max (n_rows-1, first_row));
+
+    std::string *stat_text = 0;
+    if (parameters.append_to_statistics_file)
+      {
+        std::ostringstream text;
+        if (append == false)
+          for (unsigned int j=0; j<columns.size(); ++j)
+            text << "# " << j+1 << ": " << columns[j] << '\n';
+        StatisticsTableAccessor::write_rows (statistics, first_row, end_row,
+                                             ' ', "\"\"", true, text);
+        stat_text = new std::string (text.str());
+      }
+
+    std::string *csv_text = 0;
+    if (parameters.write_statistics_csv_file)
+      {
+        std::ostringstream text;
+        if (append == false)
+          {
+            for (unsigned int j=0; j<columns.size(); ++j)
+              text << '"' << columns[j] << '"'
+                   << (j+1 < columns.size() ? "," : "");
+            text << '\n';
+          }
+        StatisticsTableAccessor::write_rows (statistics, first_row, end_row,
+                                             ',', "", false, text);
+        csv_text = new std::string (text.str());
+      }
+
+    statistics_columns_written = columns;
+    statistics_rows_written = end_row;
+
+    // if only the CSV file is written incrementally, the statistics file
+    // is still written in its entirety
+    output_statistics_thread = Threads::new_thread (&do_output_statistics_incrementally,
                                                     parameters.output_directory+"statistics",
-                                                    new TableHandler(statistics));
+                                                    (parameters.append_to_statistics_file == false
+                                                     ?
+                                                     new TableHandler(statistics)
+                                                     :
+                                                     0),
+                                                    stat_text,
+                                                    parameters.output_directory+"statistics.csv",
+                                                    csv_text,
+                                                    append);
+  }
+
+
+
+  template <int dim>
+  std::map<std::string,unsigned int>
+  Simulator<dim>::get_statistics_column_lengths () const
+  {
+    return StatisticsTableAccessor::column_lengths (statistics);
+  }
+
+
+
+  template <int dim>
+  void
+  Simulator<dim>::truncate_statistics (const std::map<std::string,unsigned int> &column_lengths)
+  {
+    StatisticsTableAccessor::truncate (statistics, column_lengths);
   }
 
 
@@ -364,6 +664,93 @@ namespace aspect
   }
 
 
+
+  template <int dim>
+  double Simulator<dim>::compute_temporal_error_estimate () const
+  {
+    Assert (old_time_step > 0, ExcInternalError());
+
+    // the linear extrapolation (1+r)*u_{n-1} - r*u_{n-2} with r=k/k_old
+    // has a local error of k*(k+k_old)/2 times the second time derivative,
+    // whereas that of the BDF2 scheme is of third order in the time step.
+    // the difference between the two solutions is therefore dominated by
+    // the error of the extrapolation, and we use it as an embedded
+    // estimate of second order, like the lower order solution of an
+    // embedded Runge-Kutta pair. compute_controlled_time_step() and
+    // solve_timestep_with_error_control() choose the time step
+    // accordingly, assuming that the estimate is proportional to k^2
+    std::vector<unsigned int> advected_blocks (1, introspection.block_indices.temperature);
+    for (unsigned int c=0; c<parameters.n_compositional_fields; ++c)
+      advected_blocks.push_back (introspection.block_indices.compositional_fields[c]);
+
+    double max_error = 0;
+    for (unsigned int b=0; b<advected_blocks.size(); ++b)
+      {
+        const unsigned int block = advected_blocks[b];
+
+        // Trilinos sadd does not like ghost vectors even as input, so
+        // copy into distributed vectors first
+        LinearAlgebra::Vector difference (introspection.index_sets.system_partitioning[block],
+                                          mpi_communicator);
+        LinearAlgebra::Vector old_old_values (introspection.index_sets.system_partitioning[block],
+                                              mpi_communicator);
+        LinearAlgebra::Vector current_values (introspection.index_sets.system_partitioning[block],
+                                              mpi_communicator);
+        difference     = old_solution.block(block);
+        old_old_values = old_old_solution.block(block);
+        current_values = solution.block(block);
+
+        // compute the extrapolation the same way solve_timestep() does,
+        // then subtract it from the current solution
+        difference.sadd ((1 + time_step/old_time_step),
+                         -time_step/old_time_step,
+                         old_old_values);
+        difference.sadd (-1., 1., current_values);
+
+        // measure the difference relative to the range of values of the
+        // field, or its magnitude if the field is constant
+        double scale = current_values.max() - current_values.min();
+        if (scale == 0)
+          scale = current_values.linfty_norm();
+        if (scale == 0)
+          scale = 1;
+
+        max_error = std::max (max_error,
+                              difference.linfty_norm() / scale);
+      }
+
+    return max_error / parameters.temporal_error_tolerance;
+  }
+
+
+
+  template <int dim>
+  double Simulator<dim>::compute_controlled_time_step () const
+  {
+    const double cfl_time_step = compute_time_step().first;
+    if (temporal_error_estimate == 0)
+      return cfl_time_step;
+
+    // use a PI controller with the usual gains for an error estimate of
+    // order two in the time step (see compute_temporal_error_estimate()),
+    // i.e., the factor is err^(-0.7/order) * err_old^(0.4/order). if there
+    // is no previous error estimate, use only the integral part. do not
+    // let the time step grow or shrink too fast, and never beyond what
+    // corresponds to the maximal CFL number allowed
+    const double order = 2;
+    double factor;
+    if (old_temporal_error_estimate == 0)
+      factor = 0.9 * std::pow (1./temporal_error_estimate, 1./order);
+    else
+      factor = 0.9 * std::pow (1./temporal_error_estimate, 0.3/order)
+               * std::pow (old_temporal_error_estimate/temporal_error_estimate, 0.4/order);
+    factor = std::min (std::max (factor, 0.2), 2.0);
+
+    return std::min (factor * time_step,
+                     cfl_time_step * parameters.maximum_CFL_number / parameters.CFL_number);
+  }
+
+
   namespace
   {
     void
@@ -732,31 +1119,76 @@ namespace aspect
 
   template <int dim>
   template<class FUNCTOR>
-  void Simulator<dim>::compute_depth_average(std::vector<double> &values,
+  void Simulator<dim>::compute_depth_average(std::vector<std::vector<double> > &values,
                                              FUNCTOR &fctr) const
   {
-    const unsigned int num_slices = values.size();
-    std::vector<double> volume(num_slices);
+    const unsigned int n_fields = values.size();
+    Assert (n_fields > 0, ExcInternalError());
+    const unsigned int num_slices = values[0].size();
 
-    // this yields 10^dim quadrature points evenly distributed in the interior of the cell.
+    // this yields n^dim quadrature points evenly distributed in the interior of the cell.
     // We avoid points on the faces, as they would be counted more than once.
     const QIterated<dim> quadrature_formula (QMidpoint<1>(),
-                                             10);
+                                             parameters.n_depth_average_quadrature_points);
     const unsigned int n_q_points = quadrature_formula.size();
     const double max_depth = geometry_model->maximal_depth();
 
+    typename DoFHandler<dim>::active_cell_iterator
+    cell = dof_handler.begin_active(),
+    endc = dof_handler.end();
+
+    // the depth slice each quadrature point falls into and its JxW value
+    // only depend on the mesh and the number of slices. compute them the
+    // first time we get here after the mesh has changed, or if we are asked
+    // for a different number of slices than last time
+    if ((depth_average_JxW.size() == 0)
+        ||
+        (depth_average_n_slices != num_slices))
+      {
+        depth_average_slices.clear();
+        depth_average_JxW.clear();
+        depth_average_n_slices = num_slices;
+
+        FEValues<dim> fe_values (mapping,
+                                 finite_element,
+                                 quadrature_formula,
+                                 update_quadrature_points | update_JxW_values);
+
+        for (; cell!=endc; ++cell)
+          if (cell->is_locally_owned())
+            {
+              fe_values.reinit (cell);
+              for (unsigned int q = 0; q < n_q_points; ++q)
+                {
+                  const unsigned int idx
+                    = static_cast<unsigned int>((geometry_model->depth(fe_values.quadrature_point(q))
+                                                 *num_slices)/max_depth);
+                  Assert(idx<num_slices, ExcInternalError());
+
+                  depth_average_slices.push_back (idx);
+                  depth_average_JxW.push_back (fe_values.JxW(q));
+                }
+            }
+        cell = dof_handler.begin_active();
+      }
+
+    // only ask for the values and gradients of the solution if
+    // we need them. the slices and JxW values come from the vectors above
     FEValues<dim> fe_values (mapping,
                              finite_element,
                              quadrature_formula,
-                             update_values | update_gradients | update_quadrature_points);
+                             update_values |
+                             update_quadrature_points |
+                             (fctr.need_material_properties()
+                              ?
+                              update_gradients
+                              :
+                              update_default));
 
     std::vector<std::vector<double> > composition_values (parameters.n_compositional_fields,std::vector<double> (n_q_points));
 
-    std::vector<double> output_values(quadrature_formula.size());
-
-    typename DoFHandler<dim>::active_cell_iterator
-    cell = dof_handler.begin_active(),
-    endc = dof_handler.end();
+    std::vector<std::vector<double> > output_values (n_fields,
+                                                     std::vector<double>(quadrature_formula.size()));
 
     typename MaterialModel::Interface<dim>::MaterialModelInputs in(n_q_points,
                                                                    parameters.n_compositional_fields);
@@ -765,10 +1197,23 @@ namespace aspect
 
     fctr.setup(quadrature_formula.size());
 
+    // accumulate the integrals of all fields and the volume of each slice
+    // in one array so that we only need a single reduction at the end:
+    // entry f*num_slices+i holds the integral of field f over slice i, and
+    // the last num_slices entries hold the volumes of the slices
+    std::vector<double> values_and_volumes ((n_fields+1)*num_slices, 0.);
+
+    unsigned int point_index = 0;
     for (; cell!=endc; ++cell)
       if (cell->is_locally_owned())
         {
           fe_values.reinit (cell);
+
+          for (unsigned int i=0; i<n_q_points; ++i)
+            in.position[i] = fe_values.quadrature_point(i);
+
+          // evaluate the material model at most once per cell, regardless of
+          // how many of the fields need material properties
           if (fctr.need_material_properties())
             {
               fe_values[introspection.extractors.pressure].get_function_values (this->solution,
@@ -782,260 +1227,280 @@ namespace aspect
                                                                                                 composition_values[c]);
 
               for (unsigned int i=0; i<n_q_points; ++i)
-                {
-                  in.position[i] = fe_values.quadrature_point(i);
-                  for (unsigned int c=0; c<parameters.n_compositional_fields; ++c)
-                    in.composition[i][c] = composition_values[c][i];
-                }
+                for (unsigned int c=0; c<parameters.n_compositional_fields; ++c)
+                  in.composition[i][c] = composition_values[c][i];
               material_model->evaluate(in, out);
             }
 
           fctr(in, out, fe_values, this->solution, output_values);
 
-          for (unsigned int q = 0; q < n_q_points; ++q)
+          for (unsigned int q = 0; q < n_q_points; ++q, ++point_index)
             {
-              const double depth = geometry_model->depth(fe_values.quadrature_point(q));
-              const unsigned int idx = static_cast<unsigned int>((depth*num_slices)/max_depth);
-              Assert(idx<num_slices, ExcInternalError());
-
-              values[idx] += output_values[q] * fe_values.JxW(q);
-              volume[idx] += fe_values.JxW(q);
+              const unsigned int idx = depth_average_slices[point_index];
+              const double JxW = depth_average_JxW[point_index];
+              for (unsigned int f=0; f<n_fields; ++f)
+                values_and_volumes[f*num_slices+idx] += output_values[f][q] * JxW;
+              values_and_volumes[n_fields*num_slices+idx] += JxW;
             }
         }
+    Assert (point_index == depth_average_JxW.size(), ExcInternalError());
 
-    std::vector<double> values_all(num_slices);
-    std::vector<double> volume_all(num_slices);
-    Utilities::MPI::sum(volume, mpi_communicator, volume_all);
-    Utilities::MPI::sum(values, mpi_communicator, values_all);
+    std::vector<double> values_and_volumes_all ((n_fields+1)*num_slices);
+    Utilities::MPI::sum(values_and_volumes, mpi_communicator, values_and_volumes_all);
 
-    for (unsigned int i=0; i<num_slices; ++i)
-      values[i] = values_all[i] / (static_cast<double>(volume_all[i])+1e-20);
+    for (unsigned int f=0; f<n_fields; ++f)
+      {
+        Assert (values[f].size() == num_slices, ExcInternalError());
+        for (unsigned int i=0; i<num_slices; ++i)
+          values[f][i] = values_and_volumes_all[f*num_slices+i]
+                         / (static_cast<double>(values_and_volumes_all[n_fields*num_slices+i])+1e-20);
+      }
   }
 
+
+
   namespace
   {
+    /**
+     * A functor for compute_depth_average() that computes any number of the
+     * quantities of which Simulator::compute_depth_averages() can compute
+     * depth averages, in one pass over the mesh.
+     */
     template <int dim>
-    class FunctorDepthAverageField
+    class FunctorDepthAverageQuantities
     {
       public:
-        FunctorDepthAverageField(const FEValuesExtractors::Scalar &field)
-          : field_(field) {}
+        FunctorDepthAverageQuantities(const std::vector<std::string>      &quantities,
+                                      const Introspection<dim>            &introspection,
+                                      const MaterialModel::Interface<dim> *material_model,
+                                      const GravityModel::Interface<dim>  *gravity_model)
+          :
+          quantities (quantities),
+          velocities (introspection.extractors.velocities),
+          material_model (material_model),
+          gravity_model (gravity_model),
+          material_properties_needed (false),
+          velocities_needed (false)
+        {
+          for (unsigned int i=0; i<quantities.size(); ++i)
+            if (quantities[i] == "temperature")
+              field_extractors.push_back (introspection.extractors.temperature);
+            else if (quantities[i].compare(0, 2, "C_") == 0)
+              {
+                const unsigned int c = Utilities::string_to_int (quantities[i].substr(2));
+                Assert (c < introspection.extractors.compositional_fields.size(),
+                        ExcMessage ("There is no compositional field <" + quantities[i] + ">."));
+                field_extractors.push_back (introspection.extractors.compositional_fields[c]);
+              }
+            else
+              {
+                // the extractor is not used for the remaining quantities
+                field_extractors.push_back (introspection.extractors.temperature);
+
+                if ((quantities[i] == "velocity magnitude")
+                    ||
+                    (quantities[i] == "sinking velocity"))
+                  velocities_needed = true;
+                else if ((quantities[i] == "viscosity")
+                         ||
+                         (quantities[i] == "Vs")
+                         ||
+                         (quantities[i] == "Vp"))
+                  material_properties_needed = true;
+                else
+                  AssertThrow (false,
+                               ExcMessage ("Can not compute a depth average of the unknown "
+                                           "quantity <" + quantities[i] + ">."));
+              }
+        }
 
         bool need_material_properties()
         {
-          return false;
+          return material_properties_needed;
         }
 
         void setup(unsigned int q_points)
         {
+          velocity_values.resize(q_points);
         }
 
         void operator()(const typename MaterialModel::Interface<dim>::MaterialModelInputs &in,
                         const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out,
                         FEValues<dim> &fe_values,
-                        const LinearAlgebra::BlockVector &solution, std::vector<double> &output)
+                        const LinearAlgebra::BlockVector &solution,
+                        std::vector<std::vector<double> > &output)
         {
-          fe_values[field_].get_function_values (solution, output);
+          // the velocity is needed by more than one quantity, so only
+          // evaluate it once
+          if (velocities_needed)
+            fe_values[velocities].get_function_values (solution, velocity_values);
+
+          for (unsigned int i=0; i<quantities.size(); ++i)
+            {
+              std::vector<double> &output_i = output[i];
+
+              if (quantities[i] == "velocity magnitude")
+                for (unsigned int q=0; q<output_i.size(); ++q)
+                  output_i[q] = velocity_values[q] * velocity_values[q];
+              else if (quantities[i] == "sinking velocity")
+                for (unsigned int q=0; q<output_i.size(); ++q)
+                  {
+                    Tensor<1,dim> g = gravity_model->gravity_vector(in.position[q]);
+                    output_i[q] = std::fabs(std::min(-1e-16,g*velocity_values[q]/g.norm()))*year_in_seconds;
+                  }
+              else if (quantities[i] == "viscosity")
+                output_i = out.viscosities;
+              else if (quantities[i] == "Vs")
+                for (unsigned int q=0; q<output_i.size(); ++q)
+                  output_i[q] = material_model->seismic_Vs(in.temperature[q], in.pressure[q],
+                                                           in.composition[q], in.position[q]);
+              else if (quantities[i] == "Vp")
+                for (unsigned int q=0; q<output_i.size(); ++q)
+                  output_i[q] = material_model->seismic_Vp(in.temperature[q], in.pressure[q],
+                                                           in.composition[q], in.position[q]);
+              else
+                // temperature or a compositional field
+                fe_values[field_extractors[i]].get_function_values (solution, output_i);
+            }
         }
 
-        const FEValuesExtractors::Scalar field_;
+      private:
+        const std::vector<std::string>        quantities;
+        std::vector<FEValuesExtractors::Scalar> field_extractors;
+        const FEValuesExtractors::Vector      velocities;
+        const MaterialModel::Interface<dim>  *material_model;
+        const GravityModel::Interface<dim>   *gravity_model;
+        bool                                  material_properties_needed;
+        bool                                  velocities_needed;
+
+        std::vector<Tensor<1,dim> >           velocity_values;
     };
   }
 
+
+
   template <int dim>
-  void Simulator<dim>::compute_depth_average_field(const TemperatureOrComposition &temperature_or_composition,
-                                                   std::vector<double> &values) const
+  void Simulator<dim>::compute_depth_averages(const std::vector<std::string> &quantities,
+                                              std::vector<std::vector<double> > &values) const
   {
-    const FEValuesExtractors::Scalar field
-      = (temperature_or_composition.is_temperature()
-         ?
-         introspection.extractors.temperature
-         :
-         introspection.extractors.compositional_fields[temperature_or_composition.compositional_variable]
-        );
+    Assert (values.size() == quantities.size(),
+            ExcDimensionMismatch (values.size(), quantities.size()));
+    if (quantities.size() == 0)
+      return;
 
-    FunctorDepthAverageField<dim> f(field);
-    compute_depth_average(values, f);
-  }
+    const unsigned int num_slices = values[0].size();
 
-  namespace
-  {
-    template <int dim>
-    class FunctorDepthAverageViscosity
-    {
-      public:
-        bool need_material_properties()
-        {
-          return true;
-        }
+    // figure out which of the requested quantities we have already
+    // computed during this postprocessing step, if any
+    std::vector<std::string> missing_quantities;
+    std::vector<unsigned int> missing_indices;
+    for (unsigned int i=0; i<quantities.size(); ++i)
+      {
+        Assert (values[i].size() == num_slices,
+                ExcMessage ("All depth averages computed at the same time need "
+                            "to use the same number of depth slices."));
+
+        const std::map<std::pair<std::string,unsigned int>, std::vector<double> >::const_iterator
+        cached = (depth_average_cache_enabled
+                  ?
+                  depth_average_cache.find (std::make_pair (quantities[i], num_slices))
+                  :
+                  depth_average_cache.end());
+
+        if (cached != depth_average_cache.end())
+          values[i] = cached->second;
+        else
+          {
+            missing_quantities.push_back (quantities[i]);
+            missing_indices.push_back (i);
+          }
+      }
 
-        void setup(unsigned int q_points)
-        {}
+    if (missing_quantities.size() == 0)
+      return;
 
-        void operator()(const typename MaterialModel::Interface<dim>::MaterialModelInputs &in,
-                        const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out,
-                        FEValues<dim> &fe_values,
-                        const LinearAlgebra::BlockVector &solution, std::vector<double> &output)
-        {
-          output = out.viscosities;
-        }
-    };
+    // then compute all of the remaining ones in a single pass
+    std::vector<std::vector<double> > missing_values (missing_quantities.size(),
+                                                      std::vector<double>(num_slices));
+    FunctorDepthAverageQuantities<dim> f (missing_quantities,
+                                          introspection,
+                                          material_model.get(),
+                                          gravity_model.get());
+    compute_depth_average (missing_values, f);
+
+    for (unsigned int i=0; i<missing_quantities.size(); ++i)
+      {
+        values[missing_indices[i]] = missing_values[i];
+        if (depth_average_cache_enabled)
+          depth_average_cache[std::make_pair (missing_quantities[i], num_slices)]
+            = missing_values[i];
+      }
   }
 
+
+
   template <int dim>
-  void Simulator<dim>::compute_depth_average_viscosity(std::vector<double> &values) const
+  void Simulator<dim>::compute_single_depth_average(const std::string   &quantity,
+                                                    std::vector<double> &values) const
   {
-    FunctorDepthAverageViscosity<dim> f;
-    compute_depth_average(values, f);
+    std::vector<std::vector<double> > all_values (1, values);
+    compute_depth_averages (std::vector<std::string>(1, quantity),
+                            all_values);
+    values = all_values[0];
   }
 
 
-  namespace
-  {
-    template <int dim>
-    class FunctorDepthAverageVelocityMagnitude
-    {
-      public:
-        FunctorDepthAverageVelocityMagnitude(const FEValuesExtractors::Vector &field)
-          : field_(field) {}
 
-        bool need_material_properties()
-        {
-          return false;
-        }
+  template <int dim>
+  void Simulator<dim>::compute_depth_average_field(const TemperatureOrComposition &temperature_or_composition,
+                                                   std::vector<double> &values) const
+  {
+    compute_single_depth_average ((temperature_or_composition.is_temperature()
+                                   ?
+                                   std::string("temperature")
+                                   :
+                                   "C_" + Utilities::int_to_string(temperature_or_composition.compositional_variable)),
+                                  values);
+  }
 
-        void setup(unsigned int q_points)
-        {
-          velocity_values.resize(q_points);
-        }
 
-        void operator()(const typename MaterialModel::Interface<dim>::MaterialModelInputs &in,
-                        const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out,
-                        FEValues<dim> &fe_values,
-                        const LinearAlgebra::BlockVector &solution, std::vector<double> &output)
-        {
-          fe_values[field_].get_function_values (solution, velocity_values);
-          for (unsigned int q=0; q<output.size(); ++q)
-            output[q] = velocity_values[q] * velocity_values[q];
-        }
 
-        std::vector<Tensor<1,dim> > velocity_values;
-        const FEValuesExtractors::Vector field_;
-    };
+  template <int dim>
+  void Simulator<dim>::compute_depth_average_viscosity(std::vector<double> &values) const
+  {
+    compute_single_depth_average ("viscosity", values);
   }
 
 
+
   template <int dim>
   void Simulator<dim>::compute_depth_average_velocity_magnitude(std::vector<double> &values) const
   {
-    FunctorDepthAverageVelocityMagnitude<dim> f(introspection.extractors.velocities);
-
-    compute_depth_average(values, f);
+    compute_single_depth_average ("velocity magnitude", values);
   }
 
-  namespace
-  {
-    template <int dim>
-    class FunctorDepthAverageSinkingVelocity
-    {
-      public:
-        FunctorDepthAverageSinkingVelocity(const FEValuesExtractors::Vector &field, GravityModel::Interface<dim> *gravity)
-          : field_(field), gravity_(gravity) {}
-
-        bool need_material_properties()
-        {
-          return false;
-        }
-
-        void setup(unsigned int q_points)
-        {
-          velocity_values.resize(q_points);
-        }
-
-        void operator()(const typename MaterialModel::Interface<dim>::MaterialModelInputs &in,
-                        const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out,
-                        FEValues<dim> &fe_values,
-                        const LinearAlgebra::BlockVector &solution, std::vector<double> &output)
-        {
-          fe_values[field_].get_function_values (solution, velocity_values);
-          for (unsigned int q=0; q<output.size(); ++q)
-            {
-              Tensor<1,dim> g = gravity_->gravity_vector(in.position[q]);
-              output[q] = std::fabs(std::min(-1e-16,g*velocity_values[q]/g.norm()))*year_in_seconds;
-            }
-        }
-
-        std::vector<Tensor<1,dim> > velocity_values;
-        const FEValuesExtractors::Vector field_;
-        GravityModel::Interface<dim> *gravity_;
-    };
-  }
 
 
   template <int dim>
   void Simulator<dim>::compute_depth_average_sinking_velocity(std::vector<double> &values) const
   {
-    FunctorDepthAverageSinkingVelocity<dim> f(introspection.extractors.velocities,
-                                              this->gravity_model.get());
-
-    compute_depth_average(values, f);
+    compute_single_depth_average ("sinking velocity", values);
   }
 
-  namespace
-  {
-    template <int dim>
-    class FunctorDepthAverageVsVp
-    {
-      public:
-        FunctorDepthAverageVsVp(const MaterialModel::Interface<dim> *mm, bool vs)
-          : material_model(mm), vs_(vs)
-        {}
-
-        bool need_material_properties()
-        {
-          return true;
-        }
-
-        void setup(unsigned int q_points)
-        {}
-
-        void operator()(const typename MaterialModel::Interface<dim>::MaterialModelInputs &in,
-                        const typename MaterialModel::Interface<dim>::MaterialModelOutputs &out,
-                        FEValues<dim> &fe_values,
-                        const LinearAlgebra::BlockVector &solution, std::vector<double> &output)
-        {
-          if (vs_)
-            for (unsigned int q=0; q<output.size(); ++q)
-              output[q] = material_model->seismic_Vs(
-                            in.temperature[q], in.pressure[q], in.composition[q],
-                            in.position[q]);
-          else
-            for (unsigned int q=0; q<output.size(); ++q)
-              output[q] = material_model->seismic_Vp(
-                            in.temperature[q], in.pressure[q], in.composition[q],
-                            in.position[q]);
-        }
-
-        const MaterialModel::Interface<dim> *material_model;
-        bool vs_;
-    };
 
-  }
 
   template <int dim>
   void Simulator<dim>::compute_depth_average_Vs(std::vector<double> &values) const
   {
-    FunctorDepthAverageVsVp<dim> f(this->material_model.get(), true /* Vs */);
-
-    compute_depth_average(values, f);
+    compute_single_depth_average ("Vs", values);
   }
 
+
+
   template <int dim>
   void Simulator<dim>::compute_depth_average_Vp(std::vector<double> &values) const
   {
-    FunctorDepthAverageVsVp<dim> f(this->material_model.get(), false /* Vp */);
-
-    compute_depth_average(values, f);
+    compute_single_depth_average ("Vp", values);
   }
 
 
@@ -1063,7 +1528,10 @@ namespace aspect
   template double Simulator<dim>::get_maximal_velocity (const LinearAlgebra::BlockVector &solution) const; \
   template std::pair<double,double> Simulator<dim>::get_extrapolated_temperature_or_composition_range (const TemperatureOrComposition &temperature_or_composition) const; \
   template std::pair<double,bool> Simulator<dim>::compute_time_step () const; \
+  template double Simulator<dim>::compute_temporal_error_estimate () const; \
+  template double Simulator<dim>::compute_controlled_time_step () const; \
   template void Simulator<dim>::make_pressure_rhs_compatible(LinearAlgebra::BlockVector &vector); \
+  template void Simulator<dim>::compute_depth_averages(const std::vector<std::string> &quantities, std::vector<std::vector<double> > &values) const; \
   template void Simulator<dim>::compute_depth_average_field(const TemperatureOrComposition &temperature_or_composition, std::vector<double> &values) const; \
   template void Simulator<dim>::compute_depth_average_viscosity(std::vector<double> &values) const; \
   template void Simulator<dim>::compute_depth_average_velocity_magnitude(std::vector<double> &values) const; \
@@ -1071,7 +1539,9 @@ namespace aspect
   template void Simulator<dim>::compute_depth_average_Vs(std::vector<double> &values) const; \
   template void Simulator<dim>::compute_depth_average_Vp(std::vector<double> &values) const; \
   template void Simulator<dim>::output_program_stats(); \
-  template void Simulator<dim>::output_statistics(); \
+  template void Simulator<dim>::output_statistics(const bool); \
+  template std::map<std::string,unsigned int> Simulator<dim>::get_statistics_column_lengths() const; \
+  template void Simulator<dim>::truncate_statistics(const std::map<std::string,unsigned int> &); \
   template bool Simulator<dim>::stokes_matrix_depends_on_solution() const; \
   template void Simulator<dim>::interpolate_onto_velocity_system(const TensorFunction<1,dim> &func, LinearAlgebra::Vector &vec);
 
@@ -26,6 +26,7 @@
 #include <deal.II/base/parameter_handler.h>
 
 #include <dirent.h>
+#include <zlib.h>
 
 
 namespace aspect
@@ -133,6 +134,36 @@ namespace aspect
                        "This parameter indicates whether the simulator should also use "
                        "heat conduction in determining the length of each time step.");
 
+    prm.declare_entry ("Use temporal error control", "false",
+                       Patterns::Bool (),
+                       "Whether to choose the time step based on an estimate of the error "
+                       "of the time discretization instead of only on the CFL number. If "
+                       "this is set, the temperature and compositional fields computed "
+                       "with the BDF2 scheme are compared with their extrapolation from "
+                       "the previous two time steps. The difference estimates the local "
+                       "error of the time step. A step whose error exceeds the "
+                       "``Temporal error tolerance'' is rejected and computed again "
+                       "with a smaller step. Otherwise a PI controller chooses the "
+                       "next step from the current and previous error estimates. This "
+                       "allows time steps larger than the ones given by the ``CFL "
+                       "number'' where the solution is smooth in time, up to the limit "
+                       "given by ``Maximum CFL number with temporal error control''. "
+                       "The number of rejected steps and the error estimates are "
+                       "written to the statistics file. This cannot be used together "
+                       "with a free surface.");
+    prm.declare_entry ("Temporal error tolerance", "1e-3",
+                       Patterns::Double (0),
+                       "The tolerance for the estimated error of a time step when using "
+                       "temporal error control, relative to the range of values of the "
+                       "temperature or compositional field in question. Units: None.");
+    prm.declare_entry ("Maximum CFL number with temporal error control", "4.0",
+                       Patterns::Double (0),
+                       "The largest CFL number (see the ``CFL number'' parameter) the "
+                       "time step may correspond to when using temporal error "
+                       "control. Since the advection equations are discretized "
+                       "implicitly, values larger than one are possible, but they will "
+                       "increase the numerical diffusion of advected fields. Units: None.");
+
     prm.declare_entry ("Nonlinear solver scheme", "IMPES",
                        Patterns::Selection ("IMPES|iterated IMPES|iterated Stokes|Stokes only"),
                        "The kind of scheme used to resolve the nonlinearity in the system. "
@@ -154,6 +185,58 @@ namespace aspect
                        "Nonlinear solver scheme is set to 'iterated Stokes' or "
                        "'iterated IMPES'.");
 
+    prm.declare_entry ("Nonlinear solver acceleration depth", "0",
+                       Patterns::Integer (0),
+                       "If larger than zero, accelerate the nonlinear iterations of "
+                       "the 'iterated IMPES' and 'Stokes only' schemes by Anderson "
+                       "acceleration. Rather than continuing from the solution "
+                       "of the last iteration, the next iteration then starts from "
+                       "the combination of the solutions of previous iterations "
+                       "that minimizes the change between iterations. This parameter "
+                       "indicates how many previous iterations are considered. Each "
+                       "of them requires storing two additional copies of the "
+                       "solution vector. A value of zero disables the acceleration.");
+
+    prm.declare_entry ("Use adaptive linear solver tolerance", "false",
+                       Patterns::Bool (),
+                       "Whether to choose the tolerances of the linear solvers "
+                       "within the nonlinear iterations of the 'iterated IMPES' "
+                       "and 'Stokes only' schemes adaptively, i.e., to solve the "
+                       "linear systems only as accurately as the progress of the "
+                       "nonlinear iteration warrants (following the second choice "
+                       "of Eisenstat and Walker). The tolerances are never "
+                       "smaller than the ones given by the 'Linear solver "
+                       "tolerance', 'Temperature solver tolerance' and "
+                       "'Composition solver tolerance' parameters, and "
+                       "never larger than 0.1.");
+
+    prm.declare_entry ("Use Newton linearization", "false",
+                       Patterns::Bool (),
+                       "Whether to linearize the Stokes equation in the nonlinear "
+                       "iterations of the 'iterated Stokes', 'iterated IMPES' and "
+                       "'Stokes only' schemes by Newton's method rather than by "
+                       "a Picard (fixed point) iteration, for material models in "
+                       "which the viscosity depends on the strain rate. The "
+                       "derivative of the viscosity is computed by a finite "
+                       "difference under the assumption that the viscosity only "
+                       "depends on the magnitude of the strain rate. Where the "
+                       "viscosity decreases with the strain rate, the derivative "
+                       "terms are limited so that the velocity block of the "
+                       "matrix remains positive definite. If the "
+                       "residual of the Stokes equation grows between two "
+                       "iterations, the remaining iterations of the time step "
+                       "fall back to the Picard linearization.");
+
+    prm.declare_entry ("Newton derivative scaling factor", "1",
+                       Patterns::Double (0,1),
+                       "A factor with which the derivative terms of the Newton "
+                       "linearization are multiplied. A value of one yields "
+                       "the full Newton linearization, smaller values yield "
+                       "a damped iteration that is more robust far away from "
+                       "the solution but converges more slowly close to it. "
+                       "This parameter is only relevant if 'Use Newton "
+                       "linearization' is set.");
+
     prm.declare_entry ("Pressure normalization", "surface",
                        Patterns::Selection ("surface|volume|no"),
                        "If and how to normalize the pressure after the solution step. "
@@ -210,6 +293,38 @@ namespace aspect
                        "The name of the directory into which all output files should be "
                        "placed. This may be an absolute or a relative path.");
 
+    prm.declare_entry ("Append to statistics file", "false",
+                       Patterns::Bool (),
+                       "Whether the 'statistics' file in the output directory should "
+                       "be written incrementally. By default, the entire file is "
+                       "reformatted and rewritten after every time step so that all "
+                       "columns line up, which becomes expensive for long runs. If "
+                       "this parameter is set, only the rows that have been added "
+                       "since the last time the file was written are appended to it, "
+                       "without aligning columns. The file is only rewritten "
+                       "completely if the set of columns has changed.");
+    prm.declare_entry ("Write statistics CSV file", "false",
+                       Patterns::Bool (),
+                       "Whether to write, in addition to the 'statistics' file, a file "
+                       "'statistics.csv' in the output directory that contains the "
+                       "same data as comma separated values with a single header line. "
+                       "This file is written incrementally in the same way as described "
+                       "for the 'Append to statistics file' parameter, and is easier "
+                       "to read into other programs.");
+
+    prm.declare_entry ("Depth average quadrature points", "10",
+                       Patterns::Integer (1),
+                       "Depth averages of the solution and of material properties "
+                       "(used, for example, by the 'depth average' postprocessor and "
+                       "some material models) are computed by integrating over each "
+                       "cell with a quadrature formula that has this many equally "
+                       "spaced points in each coordinate direction, i.e., $n^d$ points "
+                       "per cell in $d$ space dimensions. Each of these points is "
+                       "attributed to exactly one depth slice. Smaller values make "
+                       "computing depth averages considerably cheaper, but require "
+                       "that cells are small compared to the thickness of a depth "
+                       "slice for the averages to be accurate.");
+
     prm.declare_entry ("Linear solver tolerance", "1e-7",
                        Patterns::Double(0,1),
                        "A relative tolerance up to which the linear Stokes systems in each "
@@ -354,6 +469,23 @@ namespace aspect
                          "part of the boundary on which the velocity is to be zero with "
                          "the parameter ``Zero velocity boundary indicator'' in the "
                          "current parameter section.");
+      prm.declare_entry ("Reuse Stokes matrix with prescribed velocities", "false",
+                         Patterns::Bool (),
+                         "Whenever there are boundaries with prescribed velocities, the "
+                         "Stokes matrix is normally assembled again in every time step (and, "
+                         "for the 'Stokes only' and 'iterated Stokes' schemes, in every "
+                         "nonlinear iteration) since "
+                         "the boundary values may have changed. If this parameter is set, "
+                         "the matrix is only assembled again if the set of constrained "
+                         "degrees of freedom has changed (or if it needs to be rebuilt for "
+                         "other reasons). Changed boundary values are then only "
+                         "taken into account in the right hand side, which requires the "
+                         "local matrices of cells with prescribed boundary values. "
+                         "This saves the assembly of the global matrix "
+                         "and the setup of the preconditioner in every time step or "
+                         "iteration for models "
+                         "with a velocity-independent viscosity and prescribed velocities "
+                         "that do not, or only slowly, change in time.");
 
       prm.declare_entry ("Remove nullspace", "",
                          Patterns::MultipleSelection("net rotation|net translation|angular momentum|translational momentum"),
@@ -414,6 +546,44 @@ namespace aspect
                          "Whether or not the postproccessors should be run at the end "
                          "of each of ths initial adaptive refinement cycles at the "
                          "of the simulation start.");
+      prm.declare_entry ("Reuse solution on initial refinement", "false",
+                         Patterns::Bool (),
+                         "Whether the velocity and pressure computed on the mesh of one "
+                         "of the initial adaptive refinement cycles should be interpolated "
+                         "onto the refined mesh and used as the starting guess for the "
+                         "solver in the next cycle, rather than starting again from zero "
+                         "velocity and the adiabatic pressure. This can reduce the time "
+                         "needed for the start-up of a simulation considerably. The "
+                         "temperature and compositional fields are always set from the "
+                         "initial conditions on each refined mesh.");
+      prm.declare_entry ("Report mesh refinement times", "false",
+                         Patterns::Bool (),
+                         "Whether to print to screen, every time the mesh is refined, how "
+                         "long computing the error indicators, refining the mesh, setting "
+                         "up the degrees of freedom on the new mesh, and transferring the "
+                         "solution to it took.");
+      prm.declare_entry ("Target number of cells", "0",
+                         Patterns::Integer (0),
+                         "If positive, the mesh is not refined and coarsened by the "
+                         "fixed fractions given above. Rather, the fractions of cells "
+                         "to be refined and coarsened are chosen in each refinement "
+                         "step so that the mesh approaches this total number of active "
+                         "cells. This keeps the size of the problem, and consequently "
+                         "the memory and compute time it requires, predictable.");
+      prm.declare_entry ("Target number of degrees of freedom per process", "0",
+                         Patterns::Integer (0),
+                         "Like 'Target number of cells', but the target is given as the "
+                         "number of degrees of freedom per process. It is converted to a "
+                         "number of cells using the current ratio of degrees of freedom "
+                         "to cells. If both targets are given, the smaller one is used.");
+      prm.declare_entry ("Skip refinement threshold", "0",
+                         Patterns::Double (0),
+                         "If positive, a scheduled mesh refinement step is skipped "
+                         "if the l2 norm of the error indicators differs from the one "
+                         "at the last actual refinement by less than this fraction, and "
+                         "the number of cells is within the same fraction of the target "
+                         "number of cells, if one is given. A value of zero means that "
+                         "the mesh is always refined.");
     }
     prm.leave_subsection();
 
@@ -430,6 +600,42 @@ namespace aspect
                          "If 0 and time between checkpoint is not specified, "
                          "checkpointing will not be performed. "
                          "Units: None.");
+      prm.declare_entry ("Model time between checkpoints", "0",
+                         Patterns::Double (0),
+                         "If positive, a checkpoint is created whenever the model time "
+                         "passes a multiple of this value, in addition to the checkpoints "
+                         "requested by the other parameters in this section. "
+                         "Units: years if the "
+                         "'Use years in output instead of seconds' parameter is set; "
+                         "seconds otherwise.");
+      prm.declare_entry ("Number of old checkpoints to keep", "1",
+                         Patterns::Integer (0),
+                         "When a new checkpoint is created, the files of the previous one "
+                         "are renamed so that they are still available should writing the "
+                         "new one fail. This parameter determines how many such older "
+                         "checkpoints are kept. The most recent of them has files with "
+                         "the suffix '.old', older ones the suffixes '.old.2', '.old.3', "
+                         "etc. A value of zero means that the previous checkpoint is "
+                         "simply overwritten.");
+      prm.declare_entry ("Compression level", "best",
+                         Patterns::Selection ("none|fastest|default|best"),
+                         "The zlib compression level with which the part of a checkpoint "
+                         "that contains the state of the simulator object (time, statistics, "
+                         "postprocessor states, etc) is written. Higher levels produce smaller "
+                         "files but take longer to write. The data is split into blocks that "
+                         "are compressed independently and in parallel.");
+      prm.declare_entry ("Write checkpoints in the background", "false",
+                         Patterns::Bool (),
+                         "Whether the compression and writing of the simulator state "
+                         "part of a checkpoint should happen on a separate thread while "
+                         "the computation continues. The mesh and solution vectors are "
+                         "always written by all processors together before the "
+                         "computation continues. If the program is terminated before "
+                         "the background thread has finished, the newest checkpoint "
+                         "is incomplete and can not be resumed from; in that case, "
+                         "use the previous one (see 'Number of old checkpoints to "
+                         "keep'). Errors while writing in the background are only "
+                         "reported when the next checkpoint is created.");
     }
     prm.leave_subsection ();
 
@@ -568,6 +774,14 @@ namespace aspect
     resume_computation      = prm.get_bool ("Resume computation");
     CFL_number              = prm.get_double ("CFL number");
     use_conduction_timestep = prm.get_bool ("Use conduction timestep");
+    use_temporal_error_control = prm.get_bool ("Use temporal error control");
+    temporal_error_tolerance   = prm.get_double ("Temporal error tolerance");
+    maximum_CFL_number         = prm.get_double ("Maximum CFL number with temporal error control");
+    AssertThrow (temporal_error_tolerance > 0,
+                 ExcMessage ("The 'Temporal error tolerance' must be positive."));
+    AssertThrow (maximum_CFL_number > 0,
+                 ExcMessage ("The 'Maximum CFL number with temporal error control' "
+                             "must be positive."));
     convert_to_years        = prm.get_bool ("Use years in output instead of seconds");
     timing_output_frequency = prm.get_integer ("Timing output frequency");
 
@@ -590,10 +804,18 @@ namespace aspect
     nonlinear_tolerance = prm.get_double("Nonlinear solver tolerance");
 
     max_nonlinear_iterations = prm.get_integer ("Max nonlinear iterations");
+    nonlinear_acceleration_depth = prm.get_integer ("Nonlinear solver acceleration depth");
+    use_adaptive_linear_solver_tolerance = prm.get_bool ("Use adaptive linear solver tolerance");
+    use_newton_linearization = prm.get_bool ("Use Newton linearization");
+    newton_derivative_scaling_factor = prm.get_double ("Newton derivative scaling factor");
     start_time              = prm.get_double ("Start time");
     if (convert_to_years == true)
       start_time *= year_in_seconds;
 
+    append_to_statistics_file = prm.get_bool ("Append to statistics file");
+    write_statistics_csv_file = prm.get_bool ("Write statistics CSV file");
+    n_depth_average_quadrature_points = prm.get_integer ("Depth average quadrature points");
+
     output_directory        = prm.get ("Output directory");
     if (output_directory.size() == 0)
       output_directory = "./";
@@ -656,6 +878,11 @@ namespace aspect
           additional_refinement_times[i] *= year_in_seconds;
 
       run_postprocessors_on_initial_refinement = prm.get_bool("Run postprocessors on initial refinement");
+      reuse_solution_on_initial_refinement = prm.get_bool ("Reuse solution on initial refinement");
+      report_refinement_times     = prm.get_bool ("Report mesh refinement times");
+      refinement_target_n_cells   = prm.get_integer ("Target number of cells");
+      refinement_target_dofs_per_process = prm.get_integer ("Target number of degrees of freedom per process");
+      refinement_skip_threshold   = prm.get_double ("Skip refinement threshold");
     }
     prm.leave_subsection ();
 
@@ -739,6 +966,8 @@ namespace aspect
           prescribed_velocity_boundary_indicators[boundary_id] =
             std::pair<std::string,std::string>(comp,value);
         }
+      reuse_stokes_matrix_with_prescribed_velocities
+        = prm.get_bool ("Reuse Stokes matrix with prescribed velocities");
 
       {
         nullspace_removal = NullspaceRemoval::none;
@@ -769,6 +998,23 @@ namespace aspect
     {
       checkpoint_time_secs = prm.get_integer ("Time between checkpoint");
       checkpoint_steps     = prm.get_integer ("Steps between checkpoint");
+
+      if (prm.get ("Compression level") == "none")
+        checkpoint_compression_level = Z_NO_COMPRESSION;
+      else if (prm.get ("Compression level") == "fastest")
+        checkpoint_compression_level = Z_BEST_SPEED;
+      else if (prm.get ("Compression level") == "default")
+        checkpoint_compression_level = Z_DEFAULT_COMPRESSION;
+      else if (prm.get ("Compression level") == "best")
+        checkpoint_compression_level = Z_BEST_COMPRESSION;
+      else
+        AssertThrow (false, ExcNotImplemented());
+
+      checkpoint_in_background = prm.get_bool ("Write checkpoints in the background");
+      checkpoint_model_time = prm.get_double ("Model time between checkpoints");
+      if (convert_to_years == true)
+        checkpoint_model_time *= year_in_seconds;
+      n_old_checkpoints = prm.get_integer ("Number of old checkpoints to keep");
     }
     prm.leave_subsection ();
 
@@ -827,6 +1073,14 @@ namespace aspect
 
           free_surface_enabled = !free_surface_boundary_indicators.empty();
 
+          // rejecting a time step would require undoing the mesh
+          // displacement of the free surface, which we can't do
+          AssertThrow ((free_surface_enabled == false)
+                       ||
+                       (use_temporal_error_control == false),
+                       ExcMessage ("Temporal error control can not be used together "
+                                   "with a free surface."));
+
           free_surface_theta = prm.get_double("Free surface stabilization theta");
         }
         prm.leave_subsection ();
@@ -191,6 +191,15 @@ namespace aspect
 
 
 
+  template <int dim>
+  const LinearAlgebra::BlockVector &
+  SimulatorAccess<dim>::get_mesh_velocity () const
+  {
+    return simulator->mesh_velocity;
+  }
+
+
+
   template <int dim>
   const DoFHandler<dim> &
   SimulatorAccess<dim>::get_dof_handler () const
@@ -264,6 +273,14 @@ namespace aspect
     simulator->compute_depth_average_Vp(values);
   }
 
+  template <int dim>
+  void
+  SimulatorAccess<dim>::get_depth_averages(const std::vector<std::string> &quantities,
+                                           std::vector<std::vector<double> > &values) const
+  {
+    simulator->compute_depth_averages(quantities, values);
+  }
+
   template <int dim>
   const MaterialModel::Interface<dim> &
   SimulatorAccess<dim>::get_material_model () const
@@ -289,6 +306,14 @@ namespace aspect
   }
 
 
+  template <int dim>
+  const std::set<types::boundary_id> &
+  SimulatorAccess<dim>::get_free_surface_boundary_indicators () const
+  {
+    return simulator->parameters.free_surface_boundary_indicators;
+  }
+
+
   template <int dim>
   const GeometryModel::Interface<dim> &
   SimulatorAccess<dim>::get_geometry_model () const
@@ -309,6 +309,11 @@ namespace aspect
         advection_solver_tolerance = parameters.composition_solver_tolerance;
       }
 
+    // within nonlinear iterations, we may not need to solve as accurately
+    if (adaptive_linear_solver_tolerance > 0)
+      advection_solver_tolerance = std::max (advection_solver_tolerance,
+                                             adaptive_linear_solver_tolerance);
+
     const double tolerance = std::max(1e-50,
                                       advection_solver_tolerance*system_rhs.block(block_number).l2_norm());
     SolverControl solver_control (system_matrix.block(block_number, block_number).m(),
@@ -423,7 +428,15 @@ namespace aspect
     // step 1a: try if the simple and fast solver
     // succeeds in 30 steps or less (or whatever the chosen value for the
     // corresponding parameter is).
-    const double solver_tolerance = std::max (parameters.linear_stokes_solver_tolerance *
+    // within nonlinear iterations, we may not need to solve as accurately
+    const double linear_solver_tolerance
+      = (adaptive_linear_solver_tolerance > 0
+         ?
+         std::max (parameters.linear_stokes_solver_tolerance,
+                   adaptive_linear_solver_tolerance)
+         :
+         parameters.linear_stokes_solver_tolerance);
+    const double solver_tolerance = std::max (linear_solver_tolerance *
                                               distributed_stokes_rhs.l2_norm(),
                                               1e-12 * initial_residual);
     SolverControl solver_control_cheap (parameters.n_cheap_stokes_solver_steps,
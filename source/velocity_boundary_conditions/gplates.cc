@@ -26,12 +26,12 @@
 
 #include <deal.II/base/parameter_handler.h>
 #include <deal.II/base/table.h>
+#include <deal.II/base/mpi.h>
 #include <fstream>
 #include <iostream>
 #include <cmath>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/lexical_cast.hpp>
+#include <cstdlib>
+#include <cstring>
 
 
 namespace aspect
@@ -119,29 +119,154 @@ namespace aspect
         return ifile;
       }
 
+      GPlatesLookup::~GPlatesLookup()
+      {
+        if (prefetched_filename != "")
+          prefetch_thread.join();
+      }
+
+      bool
+      GPlatesLookup::read_gpml_file(const std::string   &filename,
+                                    std::vector<double> *velocities)
+      {
+        velocities->clear();
+
+        std::ifstream in (filename.c_str(), std::ios::binary);
+        if (!in)
+          return false;
+
+        // read the whole file into memory in one go
+        in.seekg (0, std::ios::end);
+        std::string contents (static_cast<std::size_t>(in.tellg()), '\0');
+        in.seekg (0, std::ios::beg);
+        if (contents.size() > 0)
+          in.read (&contents[0], contents.size());
+        if (!in)
+          return false;
+
+        // count the number of points in the domain of the velocity field.
+        // make sure we don't count <gml:pointMembers> elements
+        const std::string::size_type domain_begin = contents.find ("<gml:MultiPoint");
+        const std::string::size_type domain_end = contents.find ("</gml:MultiPoint>", domain_begin);
+        if ((domain_begin == std::string::npos) || (domain_end == std::string::npos))
+          return false;
+
+        const std::string point_tag = "<gml:pointMember";
+        unsigned int n_points = 0;
+        for (std::string::size_type pos = contents.find (point_tag, domain_begin);
+             (pos != std::string::npos) && (pos < domain_end);
+             pos = contents.find (point_tag, pos+point_tag.size()))
+          {
+            const char next = contents[pos+point_tag.size()];
+            if ((next == '>') || (next == ' '))
+              ++n_points;
+          }
+
+        // then find the list of velocities and read them as pairs
+        // of numbers separated by a comma
+        const std::string::size_type list_begin = contents.find ("<gml:tupleList>", domain_end);
+        const std::string::size_type list_end = contents.find ("</gml:tupleList>", list_begin);
+        if ((list_begin == std::string::npos) || (list_end == std::string::npos))
+          return false;
+        contents[list_end] = '\0';
+
+        velocities->reserve (2*n_points);
+        const char *p = contents.c_str() + list_begin + std::strlen ("<gml:tupleList>");
+        while (true)
+          {
+            char *end;
+            const double theta_velocity = std::strtod (p, &end);
+            if (end == p)
+              break;
+            p = end;
+            while (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')
+              ++p;
+            if (*p != ',')
+              return false;
+            ++p;
+
+            const double phi_velocity = std::strtod (p, &end);
+            if (end == p)
+              return false;
+            p = end;
+
+            velocities->push_back (theta_velocity);
+            velocities->push_back (phi_velocity);
+          }
+
+        // verify that we have read as many velocities as there are points
+        return (velocities->size() == 2*n_points);
+      }
+
+      void
+      GPlatesLookup::prefetch_file(const std::string &filename)
+      {
+        if (prefetched_filename != "")
+          prefetch_thread.join();
+
+        prefetched_filename = filename;
+        prefetch_thread = Threads::new_thread (&GPlatesLookup::read_gpml_file,
+                                               filename,
+                                               &prefetched_velocities);
+      }
+
       void
-      GPlatesLookup::load_file(const std::string &filename, const bool screen_output)
+      GPlatesLookup::load_file(const std::string &filename,
+                               const bool screen_output,
+                               const MPI_Comm mpi_communicator)
       {
         if (screen_output)
           std::cout << std::endl << "   Loading GPlates boundary velocity file "
                     << filename << "." << std::endl << std::endl;
-        using boost::property_tree::ptree;
-        ptree pt;
+
+        // read the file on the root process, or take its contents from
+        // the background thread if the file has been prefetched. the
+        // file not existing is not necessarily an error (it could be
+        // the end of the boundary condition), so we communicate it to all
+        // processes before we throw an exception on all of them. we
+        // communicate other errors the same way
+        std::vector<double> spherical_velocities;
+        int status = 0;
+        if (Utilities::MPI::this_mpi_process (mpi_communicator) == 0)
+          {
+            bool success;
+            if (filename == prefetched_filename)
+              {
+                success = prefetch_thread.return_value();
+                spherical_velocities.swap (prefetched_velocities);
+                prefetched_filename = "";
+              }
+            else
+              success = read_gpml_file (filename, &spherical_velocities);
+
+            if (!fexists(filename))
+              status = 1;
+            else if (!success)
+              status = 2;
+          }
+        MPI_Bcast (&status, 1, MPI_INT, 0, mpi_communicator);
 
         // Check whether file exists, we do not want to throw
         // an exception in case it does not, because it could be by purpose
         // (i.e. the end of the boundary condition is reached)
-        AssertThrow (fexists(filename),
+        AssertThrow (status != 1,
                      ExcMessage (std::string("GPlates file <")
                                  +
                                  filename
                                  +
                                  "> not found!"));
+        AssertThrow (status != 2,
+                     ExcMessage (std::string("Couldn't read velocities from GPlates file <")
+                                 +
+                                 filename
+                                 +
+                                 ">. Is file native gpml format for velocities?"));
 
-        // populate tree structure pt
-        read_xml(filename, pt);
-
-        const unsigned int n_points = pt.get_child("gpml:FeatureCollection.gml:featureMember.gpml:VelocityField.gml:domainSet.gml:MultiPoint").size();
+        unsigned int n_points = spherical_velocities.size() / 2;
+        MPI_Bcast (&n_points, 1, MPI_UNSIGNED, 0, mpi_communicator);
+        spherical_velocities.resize (2*n_points);
+        if (n_points > 0)
+          MPI_Bcast (&spherical_velocities[0], 2*n_points, MPI_DOUBLE, 0, mpi_communicator);
 
         // These formulas look magic, but they are the proper solution to the equation:
         // n_points = n_theta * n_phi with n_phi = 2 * (n_theta - 1)
@@ -156,6 +281,14 @@ namespace aspect
             Assert((delta_phi - 2*numbers::PI / n_phi) <= 1e-7,  ExcMessage("Resolution changed during boundary conditions. Interpolation is not working correctly."));
           }
 
+        // the cached interpolation stencils only remain valid if the data
+        // grid has not changed
+        if ((velocity_values->n_rows() != n_theta) || (velocity_values->n_cols() != n_phi))
+          {
+            Threads::Mutex::ScopedLock lock (stencil_cache_mutex);
+            stencil_cache.clear ();
+          }
+
         delta_theta =   numbers::PI / (n_theta-1);
         delta_phi   = 2*numbers::PI / n_phi;
 
@@ -166,35 +299,23 @@ namespace aspect
         (*velocity_values).reinit(n_theta,n_phi);
         velocity_positions.reinit(n_theta,n_phi);
 
-        std::string velos = pt.get<std::string>("gpml:FeatureCollection.gml:featureMember.gpml:VelocityField.gml:rangeSet.gml:DataBlock.gml:tupleList");
-        std::stringstream in(velos, std::ios::in);
-        AssertThrow (in,
-                     ExcMessage (std::string("Couldn't find velocities. Is file native gpml format for velocities?")));
+        AssertThrow(n_points == n_theta * n_phi,
+                    ExcMessage (std::string("Number of read in points does not match number of points in file. File corrupted?")));
 
-        unsigned int i = 0;
-        char sep;
-        while (!in.eof())
+        const double cmyr_si = 3.1557e9;
+        for (unsigned int i=0; i<n_points; ++i)
           {
-            Tensor<1,2> spherical_velocities;
-            const double cmyr_si = 3.1557e9;
-
-            in >> spherical_velocities[0] >> sep >> spherical_velocities[1];
-
-            if (in.eof())
-              break;
+            Tensor<1,2> point_velocities;
+            point_velocities[0] = spherical_velocities[2*i];
+            point_velocities[1] = spherical_velocities[2*i+1];
 
             // Currently it would not be necessary to update the grid positions at every timestep
             // since they are not allowed to change. In case we allow this later, do it anyway.
             const Tensor<1,3> spherical_position = get_grid_point_position(i/n_phi,i%n_phi,false);
             velocity_positions[i/n_phi][i%n_phi] = cartesian_surface_coordinates(spherical_position);
-            (*velocity_values)[i/n_phi][i%n_phi] = sphere_to_cart_velocity(spherical_velocities,spherical_position)
+            (*velocity_values)[i/n_phi][i%n_phi] = sphere_to_cart_velocity(point_velocities,spherical_position)
                                                    / cmyr_si;
-
-            i++;
           }
-
-        AssertThrow(i == n_points,
-                    ExcMessage (std::string("Number of read in points does not match number of points in file. File corrupted?")));
       }
 
       template <int dim>
@@ -228,13 +349,65 @@ namespace aspect
       Tensor<1,3>
       GPlatesLookup::interpolate (const Tensor<1,3> position, const double time_weight) const
       {
+        // find the interpolation stencil for this point, or compute
+        // it if we have not seen this point before
+        const InterpolationStencil *stencil;
+        {
+          const std::pair<double,std::pair<double,double> >
+          key (position[0], std::make_pair (position[1], position[2]));
+
+          Threads::Mutex::ScopedLock lock (stencil_cache_mutex);
+          std::map<std::pair<double,std::pair<double,double> >, InterpolationStencil>::iterator
+          p = stencil_cache.find (key);
+          if (p == stencil_cache.end())
+            {
+              p = stencil_cache.insert (std::make_pair (key, InterpolationStencil())).first;
+              compute_stencil (position, p->second);
+            }
+          p->second.used = true;
+
+          // elements of a std::map do not move when other elements
+          // are inserted, so we can use the stencil after releasing
+          // the lock
+          stencil = &p->second;
+        }
+
+        // the interpolated velocity is linear in the data, so we can
+        // first blend the velocities of the two data sets and then
+        // apply the stencil
         Tensor<1,3> surf_vel;
+        for (unsigned int k=0; k<stencil->data_point_indices.size(); ++k)
+          {
+            const unsigned int theta_index = stencil->data_point_indices[k].first;
+            const unsigned int phi_index   = stencil->data_point_indices[k].second;
+
+            Tensor<1,3> velocity = time_weight * (*velocity_values)[theta_index][phi_index];
+            if (time_weight < 1.0 - 1e-7)
+              velocity += (1-time_weight) * (*old_velocity_values)[theta_index][phi_index];
+
+            for (unsigned int i=0; i<3; ++i)
+              for (unsigned int j=0; j<3; ++j)
+                surf_vel[i] += stencil->weighted_rotations[k][i][j] * velocity[j];
+          }
+
+        const double residual_normal_velocity = (surf_vel * position) / (surf_vel.norm() * position.norm());
+
+        AssertThrow( residual_normal_velocity < 1e-11,
+                     ExcMessage("Error in velocity boundary module interpolation. "
+                                "Radial component of velocity should be zero, but is not."));
 
+        return surf_vel;
+      }
+
+      void
+      GPlatesLookup::compute_stencil (const Tensor<1,3> position,
+                                      InterpolationStencil &stencil) const
+      {
         int spatial_index[2] = {0,0};
         calculate_spatial_index(spatial_index,position);
 
         // always use closest point, ensured by the check_termination = false setting
-        double n_interpolation_weight = add_interpolation_point(surf_vel,position,spatial_index,time_weight,false);
+        double n_interpolation_weight = add_stencil_point(stencil,position,spatial_index,false);
 
         // If interpolation is requested, loop over points in theta, phi direction until we exit a circle of
         // interpolation_width radius around the evaluation point position
@@ -242,6 +415,7 @@ namespace aspect
           {
             unsigned int i = 0;
             unsigned int j = 1;
+            bool done = false;
             do
               {
                 do
@@ -250,30 +424,18 @@ namespace aspect
                       {(int)(spatial_index[0]-i), (int)(spatial_index[1]-j)}
                     };
 
-                    const double weight_1 = add_interpolation_point(surf_vel,position,idx[0],time_weight,true);
-                    const double weight_2 = add_interpolation_point(surf_vel,position,idx[1],time_weight,true);
+                    const double weight_1 = add_stencil_point(stencil,position,idx[0],true);
+                    const double weight_2 = add_stencil_point(stencil,position,idx[1],true);
 
                     // termination criterion, our interpolation points are outside of the defined circle
                     if ((std::abs(weight_1 + 1) < 1e-14) || (std::abs(weight_2 + 1) < 1e-14))
                       {
+                        // If we are outside of the interpolation circle even without extending phi (j), we have
+                        // visited all possible interpolation points. Otherwise, resetting j to 0 (phi to original
+                        // index) and moving forward in theta direction (i) might show us more interpolation points.
                         if (j == 0)
-                          {
-                            // If we are outside of the interpolation circle even without extending phi (j), we have
-                            // visited all possible interpolation points. Return current surf_vel.
-                            const double residual_normal_velocity = (surf_vel * position) / (surf_vel.norm() * position.norm());
-
-                            AssertThrow(residual_normal_velocity < 1e-11,
-                                        ExcMessage("Error in velocity boundary module interpolation. "
-                                                   "Radial component of velocity should be zero, but is not."));
-
-                            return surf_vel / n_interpolation_weight;
-                          }
-                        else
-                          {
-                            // We are outside of the interpolation circle, but resetting j to 0 (phi to original index)
-                            // and moving forward in theta direction (i) might show us more interpolation points.
-                            break;
-                          }
+                          done = true;
+                        break;
                       }
 
                     n_interpolation_weight += weight_1;
@@ -285,26 +447,21 @@ namespace aspect
                 j = 0;
                 i++;
               }
-            while (i < velocity_values->n_rows() / 2);
+            while (!done && (i < velocity_values->n_rows() / 2));
           }
 
-        const double residual_normal_velocity = (surf_vel * position) / (surf_vel.norm() * position.norm());
-
-        AssertThrow( residual_normal_velocity < 1e-11,
-                     ExcMessage("Error in velocity boundary module interpolation. "
-                                "Radial component of velocity should be zero, but is not."));
-
-        // We have interpolated over the whole dataset of the provided velocities, which is ok.
-        // Velocity will be constant for all evaluation points in this case.
-        return surf_vel / n_interpolation_weight;
+        // If we did not stop above, we have interpolated over the whole dataset of the provided
+        // velocities, which is ok. Velocity will be constant for all evaluation points in this case.
+        // In either case, normalize the weights
+        for (unsigned int k=0; k<stencil.weighted_rotations.size(); ++k)
+          stencil.weighted_rotations[k] /= n_interpolation_weight;
       }
 
       double
-      GPlatesLookup::add_interpolation_point(Tensor<1,3> &surf_vel,
-                                             const Tensor<1,3> position,
-                                             const int spatial_index[2],
-                                             const double time_weight,
-                                             const bool check_termination) const
+      GPlatesLookup::add_stencil_point(InterpolationStencil &stencil,
+                                       const Tensor<1,3> position,
+                                       const int spatial_index[2],
+                                       const bool check_termination) const
       {
         // If the point is extended over the poles, do not use it. It will be found
         // by the check in phi direction.
@@ -331,16 +488,41 @@ namespace aspect
 
         const Tensor<1,3> normalized_position = position / position.norm();
 
-        const Tensor<1,3> velocity = (*velocity_values)[idx[0]][idx[1]];
-        const Tensor<1,3> old_velocity = (*old_velocity_values)[idx[0]][idx[1]];
+        // the rotation of the data velocity into the tangent plane at the
+        // evaluation point is a linear map. compute its matrix by applying
+        // it to the unit vectors
+        Tensor<2,3> weighted_rotation;
+        for (unsigned int j=0; j<3; ++j)
+          {
+            Tensor<1,3> unit_vector;
+            unit_vector[j] = 1;
+            const Tensor<1,3> rotated = rotate_grid_velocity(cartesian_point,normalized_position,unit_vector);
+            for (unsigned int i=0; i<3; ++i)
+              weighted_rotation[i][j] = point_weight * rotated[i];
+          }
 
-        surf_vel += point_weight * time_weight * rotate_grid_velocity(cartesian_point,normalized_position,velocity);
-        if (time_weight < 1.0 - 1e-7)
-          surf_vel += point_weight * (1-time_weight) * rotate_grid_velocity(cartesian_point,normalized_position,old_velocity);
+        stencil.data_point_indices.push_back (std::make_pair (static_cast<unsigned int>(idx[0]),
+                                                              static_cast<unsigned int>(idx[1])));
+        stencil.weighted_rotations.push_back (weighted_rotation);
 
         return point_weight;
       }
 
+      void
+      GPlatesLookup::remove_unused_stencils ()
+      {
+        Threads::Mutex::ScopedLock lock (stencil_cache_mutex);
+        for (std::map<std::pair<double,std::pair<double,double> >, InterpolationStencil>::iterator
+             p = stencil_cache.begin(); p != stencil_cache.end(); )
+          if (p->second.used == false)
+            stencil_cache.erase (p++);
+          else
+            {
+              p->second.used = false;
+              ++p;
+            }
+      }
+
       Tensor<1,3>
       GPlatesLookup::rotate_grid_velocity(const Tensor<1,3> data_position, const Tensor<1,3> point_position, const Tensor<1,3> data_velocity) const
       {
@@ -542,6 +724,10 @@ namespace aspect
     GPlates<dim>::set_current_time (const double time)
     {
       current_time = time - velocity_file_start_time;
+
+      if (lookup)
+        lookup->remove_unused_stencils ();
+
       const bool first_process = (Utilities::MPI::this_mpi_process (
                                     this->get_mpi_communicator ())
                                   == 0);
@@ -554,7 +740,8 @@ namespace aspect
             lookup->screen_output<dim> (pointone, pointtwo);
 
           lookup->load_file (create_filename (current_time_step),
-                             first_process);
+                             first_process,
+                             this->get_mpi_communicator());
           end_time_dependence (current_time_step, first_process);
           return;
         }
@@ -593,7 +780,8 @@ namespace aspect
         try
           {
             lookup->load_file (create_filename (current_time_step),
-                               first_process);
+                               first_process,
+                               this->get_mpi_communicator());
           }
         catch (...)
           // If loading current_time_step failed, end time dependent part with old_time_step.
@@ -620,7 +808,13 @@ namespace aspect
       try
         {
           lookup->load_file (create_filename (current_time_step + 1),
-                             first_process);
+                             first_process,
+                             this->get_mpi_communicator());
+
+          // start reading the file after that in the background, so
+          // that it is available once we get there
+          if (first_process)
+            lookup->prefetch_file (create_filename (current_time_step + 2));
         }
 
       // If loading current_time_step + 1 failed, end time dependent part with current_time_step.
@@ -641,7 +835,8 @@ namespace aspect
     {
       // Next velocity file not found --> Constant velocities
       // by simply loading the old file twice
-      lookup->load_file (create_filename (timestep), first_process);
+      lookup->load_file (create_filename (timestep), first_process,
+                         this->get_mpi_communicator());
       // no longer consider the problem time dependent from here on out
       // this cancels all attempts to read files at the next time steps
       time_dependent = false;
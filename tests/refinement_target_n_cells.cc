@@ -0,0 +1,76 @@
+#include <aspect/postprocess/interface.h>
+#include <aspect/simulator_access.h>
+
+#include <fstream>
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    template <int dim>
+    class CellCountCheck : public Interface<dim>, public ::aspect::SimulatorAccess<dim>
+    {
+      public:
+        CellCountCheck ();
+
+        virtual
+        std::pair<std::string,std::string>
+        execute (TableHandler &statistics);
+
+      private:
+        bool within_target_range;
+    };
+  }
+}
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    template <int dim>
+    CellCountCheck<dim>::CellCountCheck ()
+      :
+      within_target_range (true)
+    {}
+
+
+    template <int dim>
+    std::pair<std::string,std::string>
+    CellCountCheck<dim>::execute (TableHandler &)
+    {
+      // the target number of cells given in the input file
+      const double target_n_cells = 200;
+
+      const double n_cells = this->get_triangulation().n_global_active_cells();
+      if ((n_cells < 0.5 * target_n_cells) || (n_cells > 1.5 * target_n_cells))
+        within_target_range = false;
+
+      // write the result so far into a file. we do not write the actual
+      // number of cells since it depends on the details of the refinement
+      if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
+        {
+          std::ofstream out ((this->get_output_directory() + "cell-count-check").c_str());
+          out << "Number of cells within 50% of the target in all time steps: "
+              << (within_target_range ? "yes" : "no") << std::endl;
+        }
+
+      return std::pair<std::string, std::string> ("Number of cells within target range:",
+                                                  within_target_range ? "yes" : "no");
+    }
+  }
+}
+
+
+// explicit instantiations
+namespace aspect
+{
+  namespace Postprocess
+  {
+    ASPECT_REGISTER_POSTPROCESSOR(CellCountCheck,
+                                  "cell count check",
+                                  "A postprocessor that checks that the number of cells "
+                                  "stays close to the target number of cells.")
+  }
+}
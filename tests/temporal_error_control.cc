@@ -0,0 +1,127 @@
+#include <aspect/postprocess/interface.h>
+#include <aspect/simulator_access.h>
+
+#include <fstream>
+#include <sstream>
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    template <int dim>
+    class TemporalErrorCheck : public Interface<dim>, public ::aspect::SimulatorAccess<dim>
+    {
+      public:
+        TemporalErrorCheck ();
+
+        virtual
+        std::pair<std::string,std::string>
+        execute (TableHandler &statistics);
+
+      private:
+        bool         statistics_consistent;
+        unsigned int last_n_rejected_time_steps;
+    };
+  }
+}
+
+
+namespace aspect
+{
+  namespace Postprocess
+  {
+    template <int dim>
+    TemporalErrorCheck<dim>::TemporalErrorCheck ()
+      :
+      statistics_consistent (true),
+      last_n_rejected_time_steps (0)
+    {}
+
+
+    template <int dim>
+    std::pair<std::string,std::string>
+    TemporalErrorCheck<dim>::execute (TableHandler &statistics)
+    {
+      // TableHandler does not provide access to individual entries, so
+      // write the table into a string and read the columns of interest
+      // from the last row. the format starts with one line '# n: name'
+      // per column, followed by one line per row
+      std::ostringstream table;
+      statistics.write_text (table,
+                             TableHandler::simple_table_with_separate_column_description);
+
+      std::istringstream in (table.str());
+      std::string line, last_row;
+      int error_column = -1, rejected_column = -1;
+      while (std::getline (in, line))
+        if ((line.size() > 0) && (line[0] == '#'))
+          {
+            const std::string::size_type colon = line.find (':');
+            const int column = Utilities::string_to_int (line.substr (2, colon-2)) - 1;
+            const std::string name = line.substr (colon+2);
+            if (name == "Relative temporal error estimate")
+              error_column = column;
+            else if (name == "Number of rejected time steps")
+              rejected_column = column;
+          }
+        else if (line.size() > 0)
+          last_row = line;
+
+      if ((error_column < 0) || (rejected_column < 0))
+        statistics_consistent = false;
+      else
+        {
+          std::istringstream row (last_row);
+          std::vector<std::string> entries;
+          std::string entry;
+          while (row >> entry)
+            entries.push_back (entry);
+
+          if (entries.size() <= static_cast<unsigned int>(std::max (error_column, rejected_column)))
+            statistics_consistent = false;
+          else
+            {
+              // the estimate of an accepted time step must satisfy the
+              // tolerance, i.e., be at most one relative to it, and the
+              // number of rejected time steps can only grow
+              const double error_estimate
+                = Utilities::string_to_double (entries[error_column]);
+              const unsigned int n_rejected_time_steps
+                = Utilities::string_to_int (entries[rejected_column]);
+
+              if ((error_estimate < 0) || (error_estimate > 1))
+                statistics_consistent = false;
+              if (n_rejected_time_steps < last_n_rejected_time_steps)
+                statistics_consistent = false;
+              last_n_rejected_time_steps = n_rejected_time_steps;
+            }
+        }
+
+      // write the result so far into a file. we do not write the actual
+      // estimates since they depend on the details of the solvers
+      if (Utilities::MPI::this_mpi_process(this->get_mpi_communicator()) == 0)
+        {
+          std::ofstream out ((this->get_output_directory() + "temporal-error-check").c_str());
+          out << "Temporal error statistics consistent in all time steps: "
+              << (statistics_consistent ? "yes" : "no") << std::endl;
+        }
+
+      return std::pair<std::string, std::string> ("Temporal error statistics consistent:",
+                                                  statistics_consistent ? "yes" : "no");
+    }
+  }
+}
+
+
+// explicit instantiations
+namespace aspect
+{
+  namespace Postprocess
+  {
+    ASPECT_REGISTER_POSTPROCESSOR(TemporalErrorCheck,
+                                  "temporal error check",
+                                  "A postprocessor that checks the statistics written "
+                                  "by the temporal error control.")
+  }
+}